@@ -0,0 +1,515 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <engine/camera.hpp>
+#include <engine/framebuffer.hpp>
+#include <engine/gl_handle.hpp>
+#include <engine/gpu_arena.hpp>
+#include <engine/instance_buffer.hpp>
+#include <engine/material.hpp>
+#include <engine/mesh.hpp>
+#include <engine/pyramid.hpp>
+#include <engine/scene.hpp>
+#include <engine/scene_generator.hpp>
+#include <engine/scene_shaders.hpp>
+#include <engine/shader.hpp>
+#include <engine/uniform_buffer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Headless scaling benchmark. For every object count and renderer variant it
+// renders a generated scene into an offscreen target and writes one CSV row
+// with the average CPU submit time, GPU time and frames per second.
+//
+// Only opaque pyramids are drawn, so the variants differ purely in how the
+// geometry is submitted. Every variant frustum culls: on the CPU for the
+// first three, in a compute shader for the last.
+
+enum class Variant {
+    PerObject,          // drawObject per visible object, one range bind each
+    Instanced,          // visible transforms uploaded, one instanced draw
+    MultiDrawIndirect,  // one indirect command per visible object, one multi-draw
+    GpuCulled           // compute shader culls and writes the indirect commands
+};
+
+const char* variantName(Variant variant) {
+    switch (variant) {
+	case Variant::PerObject: return "per-object";
+	case Variant::Instanced: return "instanced";
+	case Variant::MultiDrawIndirect: return "mdi";
+	case Variant::GpuCulled: return "gpu-culled";
+    }
+    return "unknown";
+}
+
+bool parseVariant(const std::string& name, Variant& variant) {
+    for (Variant v : { Variant::PerObject, Variant::Instanced, Variant::MultiDrawIndirect, Variant::GpuCulled }) {
+	if (name == variantName(v)) {
+	    variant = v;
+	    return true;
+	}
+    }
+    return false;
+}
+
+// Layout of one glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct BenchOptions {
+    std::vector<uint64_t> counts = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    std::vector<Variant> variants = {
+	Variant::PerObject, Variant::Instanced, Variant::MultiDrawIndirect, Variant::GpuCulled
+    };
+    SceneLayout layout = SceneLayout::Scatter;
+    uint64_t seed = 1;
+    int warmupFrames = 10;
+    int frames = 100;
+    int width = 1280;
+    int height = 720;
+    std::string csvPath;
+};
+
+// Splits a comma separated list
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+	if (!item.empty()) {
+	    items.push_back(item);
+	}
+    }
+    return items;
+}
+
+// std::stoull wraps a negative number such as "-1" around to a huge value
+// instead of rejecting it
+uint64_t parseUnsigned(const std::string& text) {
+    if (text.find('-') != std::string::npos) {
+	throw std::invalid_argument(text);
+    }
+    return std::stoull(text);
+}
+
+void printBenchUsage(const char* program) {
+    std::cerr << "Usage: " << program
+	<< " [--counts 1,10,...] [--variants per-object,instanced,mdi,gpu-culled]"
+	<< " [--layout grid|scatter|clustered|overlap|orbits] [--seed n]"
+	<< " [--warmup n] [--frames n] [--size WxH] [--csv file]" << std::endl;
+}
+
+bool parseBenchOptions(int argc, char** argv, BenchOptions& options) {
+    try {
+	for (int i = 1; i < argc; ++i) {
+	    std::string arg = argv[i];
+
+	    if (arg == "--counts" && i + 1 < argc) {
+		options.counts.clear();
+		for (const auto& count : splitList(argv[++i])) {
+		    options.counts.push_back(parseUnsigned(count));
+		}
+	    } else if (arg == "--variants" && i + 1 < argc) {
+		options.variants.clear();
+		for (const auto& name : splitList(argv[++i])) {
+		    Variant variant;
+		    if (!parseVariant(name, variant)) {
+			std::cerr << "Unknown variant " << name << std::endl;
+			return false;
+		    }
+		    options.variants.push_back(variant);
+		}
+	    } else if (arg == "--layout" && i + 1 < argc) {
+		if (!parseSceneLayout(argv[++i], options.layout)) {
+		    std::cerr << "Unknown layout " << argv[i] << std::endl;
+		    return false;
+		}
+	    } else if (arg == "--seed" && i + 1 < argc) {
+		options.seed = parseUnsigned(argv[++i]);
+	    } else if (arg == "--warmup" && i + 1 < argc) {
+		options.warmupFrames = std::stoi(argv[++i]);
+	    } else if (arg == "--frames" && i + 1 < argc) {
+		options.frames = std::max(1, std::stoi(argv[++i]));
+	    } else if (arg == "--size" && i + 1 < argc) {
+		std::string size = argv[++i];
+		size_t x = size.find('x');
+		if (x == std::string::npos) {
+		    std::cerr << "Expected --size WIDTHxHEIGHT" << std::endl;
+		    return false;
+		}
+		options.width = std::stoi(size.substr(0, x));
+		options.height = std::stoi(size.substr(x + 1));
+	    } else if (arg == "--csv" && i + 1 < argc) {
+		options.csvPath = argv[++i];
+	    } else {
+		printBenchUsage(argv[0]);
+		return false;
+	    }
+	}
+    } catch (const std::invalid_argument&) {
+	printBenchUsage(argv[0]);
+	return false;
+    } catch (const std::out_of_range&) {
+	printBenchUsage(argv[0]);
+	return false;
+    }
+
+    return true;
+}
+
+struct BenchResult {
+    double cpuSubmitMs;
+    double gpuMs;
+    double fps;
+};
+
+// GL state shared by every run
+class BenchRenderer {
+private:
+    Program perObjectProgram;
+    Program indirectProgram;
+    Program cullProgram;
+
+    SceneFramebuffer target;
+    UniformStream uniforms;
+    InstanceBuffer transforms;
+    Buffer commands;
+    Buffer drawCount;
+    size_t commandCapacity;
+
+    std::vector<glm::mat4> visibleTransforms;
+    std::vector<DrawElementsIndirectCommand> indirect;
+
+    // Makes the indirect command buffer hold at least count commands
+    void reserveCommands(size_t count) {
+	size_t bytes = std::max<size_t>(count, 1) * sizeof(DrawElementsIndirectCommand);
+	if (bytes > commandCapacity) {
+	    commandCapacity = bytes;
+	    commands = Buffer::create();
+	    glNamedBufferData(commands.get(), commandCapacity, nullptr, GL_STREAM_DRAW);
+	}
+    }
+
+public:
+    BenchRenderer()
+        : perObjectProgram{createProgram(vertexShaderSource, fragmentShaderSource)},
+          indirectProgram{createProgram(indirectVertexShaderSource, fragmentShaderSource)},
+          cullProgram{createComputeProgram(cullComputeShaderSource)},
+          target{},
+          uniforms{},
+          transforms{},
+          commands{},
+          drawCount{Buffer::create()},
+          commandCapacity{0},
+          visibleTransforms{},
+          indirect{}
+    {
+        glNamedBufferData(drawCount.get(), sizeof(GLuint), nullptr, GL_STREAM_DRAW);
+    }
+
+    bool isValid() const {
+	return perObjectProgram && indirectProgram && cullProgram;
+    }
+
+    bool resize(int width, int height) {
+	return target.resize(width, height);
+    }
+
+    GLuint getPerObjectProgram() const {
+	return perObjectProgram.get();
+    }
+
+    // Submits one frame of the variant. Everything from the first GL call to
+    // the last is what the CPU submit time measures.
+    void submit(
+	Variant variant,
+	const Scene& scene,
+	const std::vector<glm::mat4>& transformsNow,
+	const FrameConstants& frame,
+	const Mesh& mesh)
+    {
+	const std::vector<Renderable>& renderables = scene.column<Renderable>();
+	const std::vector<Bounds>& bounds = scene.column<Bounds>();
+
+	Frustum frustum(frame.viewProjection);
+	size_t stride = uniforms.stride(sizeof(ObjectConstants));
+	size_t objectsSize = variant == Variant::PerObject ? scene.size() * stride : 0;
+
+	uniforms.beginFrame(uniforms.stride(sizeof(FrameConstants)) + objectsSize);
+	GLintptr frameSlot = uniforms.allocate(sizeof(FrameConstants));
+	GLintptr objects = uniforms.allocate(objectsSize);
+	*static_cast<FrameConstants*>(uniforms.pointer(frameSlot)) = frame;
+
+	target.bind();
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glBindBufferRange(GL_UNIFORM_BUFFER, frameBlockBinding, uniforms.get(), frameSlot, sizeof(FrameConstants));
+
+	GLuint firstIndex = (GLuint)(mesh.getIndexRange().offset / indexTypeSize(mesh.getIndexType()));
+
+	switch (variant) {
+	    case Variant::PerObject: {
+		glUseProgram(perObjectProgram.get());
+		glUniform1f(glGetUniformLocation(perObjectProgram.get(), "alpha"), 1.0f);
+
+		for (size_t i = 0; i < scene.size(); ++i) {
+		    if (isVisible(frustum, transformsNow[i], bounds[i])) {
+			drawObject(renderables[i], uniforms, objects + i * stride, transformsNow[i]);
+		    }
+		}
+		break;
+	    }
+	    case Variant::Instanced: {
+		visibleTransforms.clear();
+		for (size_t i = 0; i < transformsNow.size(); ++i) {
+		    if (isVisible(frustum, transformsNow[i], bounds[i])) {
+			visibleTransforms.push_back(transformsNow[i]);
+		    }
+		}
+
+		transforms.upload(visibleTransforms);
+		transforms.bind(0);
+
+		glUseProgram(indirectProgram.get());
+		glUniform1f(glGetUniformLocation(indirectProgram.get(), "alpha"), 1.0f);
+		mesh.drawInstanced(visibleTransforms.size());
+		break;
+	    }
+	    case Variant::MultiDrawIndirect: {
+		indirect.clear();
+		for (size_t i = 0; i < transformsNow.size(); ++i) {
+		    if (isVisible(frustum, transformsNow[i], bounds[i])) {
+			indirect.push_back({ (GLuint)mesh.getIndexCount(), 1, firstIndex, 0, (GLuint)i });
+		    }
+		}
+
+		transforms.upload(transformsNow);
+		transforms.bind(0);
+
+		reserveCommands(indirect.size());
+		glNamedBufferSubData(commands.get(), 0, indirect.size() * sizeof(DrawElementsIndirectCommand), indirect.data());
+
+		glUseProgram(indirectProgram.get());
+		glUniform1f(glGetUniformLocation(indirectProgram.get(), "alpha"), 1.0f);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.get());
+		mesh.bind();
+		glMultiDrawElementsIndirect(GL_TRIANGLES, mesh.getIndexType(), nullptr, indirect.size(), 0);
+		glBindVertexArray(0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		break;
+	    }
+	    case Variant::GpuCulled: {
+		transforms.upload(transformsNow);
+		transforms.bind(0);
+
+		reserveCommands(transformsNow.size());
+		GLuint zero = 0;
+		glClearNamedBufferData(drawCount.get(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+		GLuint program = cullProgram.get();
+		glUseProgram(program);
+		glUniform4fv(glGetUniformLocation(program, "planes"), 6, &frustum.planes[0][0]);
+		glUniform1ui(glGetUniformLocation(program, "objectCount"), (GLuint)transformsNow.size());
+		glUniform1ui(glGetUniformLocation(program, "indexCount"), (GLuint)mesh.getIndexCount());
+		glUniform1ui(glGetUniformLocation(program, "firstIndex"), firstIndex);
+		glUniform1f(glGetUniformLocation(program, "boundingRadius"), Pyramid::boundingRadius);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commands.get());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, drawCount.get());
+		glDispatchCompute((GLuint)((transformsNow.size() + 255) / 256), 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+		glUseProgram(indirectProgram.get());
+		glUniform1f(glGetUniformLocation(indirectProgram.get(), "alpha"), 1.0f);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.get());
+		glBindBuffer(GL_PARAMETER_BUFFER, drawCount.get());
+		mesh.bind();
+		glMultiDrawElementsIndirectCount(GL_TRIANGLES, mesh.getIndexType(), nullptr, 0, transformsNow.size(), 0);
+		glBindVertexArray(0);
+		glBindBuffer(GL_PARAMETER_BUFFER, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		break;
+	    }
+	}
+
+	uniforms.endFrame();
+    }
+};
+
+// Runs warmup and measured frames of one variant. GPU time comes from a
+// small ring of timer queries, read back a few frames late so the CPU never
+// waits on the frame it just submitted.
+BenchResult runVariant(
+    BenchRenderer& renderer,
+    Variant variant,
+    Scene& scene,
+    const Camera& camera,
+    const Mesh& mesh,
+    const BenchOptions& options)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr size_t queryCount = 4;
+
+    std::array<Query, queryCount> queries;
+    for (auto& query : queries) {
+	query = Query::create();
+    }
+
+    FramePacket packet{};
+    FrameConstants frame{};
+    frame.view = camera.view();
+    frame.projection = camera.projectionMatrix((float)options.width / (float)options.height);
+    frame.viewProjection = frame.projection * frame.view;
+
+    int totalFrames = options.warmupFrames + options.frames;
+    double cpuSubmit = 0.0;
+    double gpuTime = 0.0;
+    clock::time_point measureStart = clock::now();
+
+    auto collect = [&](int frameIndex) {
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(queries[frameIndex % queryCount].get(), GL_QUERY_RESULT, &elapsed);
+	if (frameIndex >= options.warmupFrames) {
+	    gpuTime += elapsed * 1e-6;
+	}
+    };
+
+    for (int f = 0; f < totalFrames; ++f) {
+	// The query about to be reused still holds frame f - queryCount
+	if (f >= (int)queryCount) {
+	    collect(f - queryCount);
+	}
+	if (f == options.warmupFrames) {
+	    measureStart = clock::now();
+	}
+
+	// Fixed 60 Hz steps so every variant animates identically
+	simulateFrame(scene, 1.0f / 60.0f, packet);
+	frame.time = f / 60.0f;
+
+	auto submitStart = clock::now();
+	glBeginQuery(GL_TIME_ELAPSED, queries[f % queryCount].get());
+	renderer.submit(variant, scene, packet.transforms, frame, mesh);
+	glEndQuery(GL_TIME_ELAPSED);
+	glFlush();
+	auto submitEnd = clock::now();
+
+	if (f >= options.warmupFrames) {
+	    cpuSubmit += std::chrono::duration<double, std::milli>(submitEnd - submitStart).count();
+	}
+    }
+
+    glFinish();
+    double wall = std::chrono::duration<double>(clock::now() - measureStart).count();
+
+    for (int f = std::max(0, totalFrames - (int)queryCount); f < totalFrames; ++f) {
+	collect(f);
+    }
+
+    return { cpuSubmit / options.frames, gpuTime / options.frames, options.frames / wall };
+}
+
+int runBenchmark(const BenchOptions& options, std::ostream& csv) {
+    BenchRenderer renderer;
+    if (!renderer.isValid()) {
+	return -1;
+    }
+    renderer.resize(options.width, options.height);
+
+    GpuBufferArena arena;
+    Mesh mesh(arena, Pyramid::meshData(), Pyramid::vertexFormat);
+    Material opaqueMaterial(renderer.getPerObjectProgram(), BlendMode::Opaque);
+
+    glEnable(GL_DEPTH_TEST);
+
+    csv << "variant,count,frames,cpu_submit_ms,gpu_ms,fps" << std::endl;
+
+    for (uint64_t count : options.counts) {
+	SceneGeneratorOptions generator;
+	generator.layout = options.layout;
+	generator.count = count;
+	generator.seed = options.seed;
+	generator.translucentRatio = 0.0f;
+
+	float extent = generatedSceneExtent(generator);
+	Camera camera;
+	camera.frame(extent);
+	camera.setClipPlanes(0.01f, std::max(1000.0f, 4.0f * extent + 0.01f * (float)count));
+
+	for (Variant variant : options.variants) {
+	    // Rebuilt per variant so each starts from the same poses
+	    Scene scene;
+	    buildGeneratedScene(scene, generator, &mesh, &opaqueMaterial, &opaqueMaterial);
+
+	    std::cerr << variantName(variant) << " x " << count << "..." << std::endl;
+	    BenchResult result = runVariant(renderer, variant, scene, camera, mesh, options);
+
+	    csv << variantName(variant) << ',' << count << ',' << options.frames << ','
+		<< result.cpuSubmitMs << ',' << result.gpuMs << ',' << result.fps << std::endl;
+	}
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseBenchOptions(argc, argv, options)) {
+	return -1;
+    }
+
+    std::ofstream file;
+    if (!options.csvPath.empty()) {
+	file.open(options.csvPath);
+	if (!file) {
+	    std::cerr << "Failed to open " << options.csvPath << std::endl;
+	    return -1;
+	}
+    }
+    std::ostream& csv = options.csvPath.empty() ? std::cout : file;
+
+    // Never shown and never swapped: everything renders offscreen. On CI
+    // nodes without a display this runs under a virtual X server.
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    GLFWwindow* window = glfwCreateWindow(1, 1, "Pyramid benchmark", NULL, NULL);
+    if (window == nullptr) {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cerr << "Failed to init GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    int result = runBenchmark(options, csv);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    return result;
+}
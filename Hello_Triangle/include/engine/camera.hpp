@@ -0,0 +1,138 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+enum class Projection {
+    Perspective,
+    Orthographic
+};
+
+// Six planes (a, b, c, d) of a view volume with normals pointing inwards,
+// extracted from a view-projection matrix
+struct Frustum {
+    std::array<glm::vec4, 6> planes;
+
+    explicit Frustum(const glm::mat4& viewProjection) {
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	planes = {{ row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 }};
+
+	for (auto& plane : planes) {
+	    plane /= glm::length(glm::vec3(plane));
+	}
+    }
+
+    // Conservative: may accept spheres just outside a corner
+    bool intersectsSphere(const glm::vec3& center, float radius) const {
+	for (const auto& plane : planes) {
+	    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+		return false;
+	    }
+	}
+	return true;
+    }
+};
+
+// Free-flying camera. Yaw and pitch are in degrees; yaw 0 looks down -Z.
+class Camera {
+private:
+    glm::vec3 position;
+    float yaw, pitch;
+    Projection projection;
+    float fieldOfView;      // vertical, degrees, perspective only
+    float orthoHeight;      // height of the view volume, orthographic only
+    float nearPlane, farPlane;
+
+public:
+    Camera()
+        : position{0.0f, 0.0f, 0.0f},
+          yaw{0.0f},
+          pitch{0.0f},
+          projection{Projection::Perspective},
+          fieldOfView{45.0f},
+          orthoHeight{2.0f},
+          nearPlane{0.01f},
+          farPlane{1000.0f}
+    {}
+
+    glm::vec3 getPosition() const {
+	return position;
+    }
+
+    void setPosition(const glm::vec3& newPosition) {
+	position = newPosition;
+    }
+
+    Projection getProjection() const {
+	return projection;
+    }
+
+    void setProjection(Projection newProjection) {
+	projection = newProjection;
+    }
+
+    void setFieldOfView(float degrees) {
+	fieldOfView = degrees;
+    }
+
+    void setOrthoHeight(float height) {
+	orthoHeight = height;
+    }
+
+    void setClipPlanes(float near, float far) {
+	nearPlane = near;
+	farPlane = far;
+    }
+
+    // Places the camera on +Z so a height x height square at the origin
+    // exactly fills the view vertically, in either projection
+    void frame(float height) {
+	orthoHeight = height;
+	position = glm::vec3(0.0f, 0.0f, height * 0.5f / std::tan(glm::radians(fieldOfView) * 0.5f));
+	yaw = 0.0f;
+	pitch = 0.0f;
+    }
+
+    glm::vec3 forward() const {
+	float y = glm::radians(yaw);
+	float p = glm::radians(pitch);
+	return glm::vec3(std::sin(y) * std::cos(p), std::sin(p), -std::cos(y) * std::cos(p));
+    }
+
+    glm::vec3 right() const {
+	return glm::normalize(glm::cross(forward(), glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+
+    // Moves along the camera's own axes
+    void move(const glm::vec3& amount) {
+	position += right() * amount.x + glm::vec3(0.0f, 1.0f, 0.0f) * amount.y + forward() * amount.z;
+    }
+
+    // Pitch is clamped short of straight up or down
+    void turn(float yawDegrees, float pitchDegrees) {
+	yaw = std::fmod(yaw + yawDegrees, 360.0f);
+	pitch = std::clamp(pitch + pitchDegrees, -89.0f, 89.0f);
+    }
+
+    glm::mat4 view() const {
+	return glm::lookAt(position, position + forward(), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    glm::mat4 projectionMatrix(float aspect) const {
+	if (projection == Projection::Orthographic) {
+	    float halfHeight = orthoHeight * 0.5f;
+	    float halfWidth = halfHeight * aspect;
+	    return glm::ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, nearPlane, farPlane);
+	}
+
+	return glm::perspective(glm::radians(fieldOfView), aspect, nearPlane, farPlane);
+    }
+};
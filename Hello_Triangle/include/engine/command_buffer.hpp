@@ -0,0 +1,176 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <engine/linear_allocator.hpp>
+
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+// Compact stream of GL commands. Any thread can record into its own
+// CommandBuffer; only the GL thread replays them. Commands are plain structs
+// laid out back to back in a LinearAllocator, each starting with a header
+// that gives its type and size, so replay is a single forward walk.
+enum class CommandType : uint16_t {
+    BindProgram,
+    BindVertexArray,
+    SetUniformFloat,
+    DrawIndexedInstanced
+};
+
+struct CommandHeader {
+    CommandType type;
+    uint16_t size;
+};
+
+// Every command starts at a multiple of this within its chunk
+constexpr size_t commandAlignment = 8;
+
+struct BindProgramCommand {
+    CommandHeader header;
+    GLuint program;
+};
+
+struct BindVertexArrayCommand {
+    CommandHeader header;
+    GLuint vertexArray;
+};
+
+struct SetUniformFloatCommand {
+    CommandHeader header;
+    GLint location;
+    float value;
+};
+
+struct DrawIndexedInstancedCommand {
+    CommandHeader header;
+    GLenum indexType;
+    GLsizei indexCount;
+    GLintptr indexOffset;
+    GLsizei instanceCount;
+    GLuint baseInstance;
+};
+
+class CommandBuffer {
+private:
+    LinearAllocator allocator;
+    size_t commandCount;
+
+    // Redundant binds are filtered while recording
+    GLuint boundProgram;
+    GLuint boundVertexArray;
+
+    template <typename T>
+    T& push(CommandType type) {
+	static_assert(std::is_trivially_copyable<T>::value, "commands must be POD");
+	static_assert(sizeof(T) <= UINT16_MAX, "command too large");
+	static_assert(alignof(T) <= commandAlignment, "command over-aligned");
+
+	T* command = new (allocator.allocate(sizeof(T), commandAlignment)) T{};
+	command->header = { type, (uint16_t)sizeof(T) };
+	++commandCount;
+	return *command;
+    }
+
+public:
+    CommandBuffer()
+        : allocator{},
+          commandCount{0},
+          boundProgram{0},
+          boundVertexArray{0}
+    {}
+
+    // Forgets every command and bind, keeping the memory for the next frame
+    void reset() {
+	allocator.reset();
+	commandCount = 0;
+	boundProgram = 0;
+	boundVertexArray = 0;
+    }
+
+    size_t size() const {
+	return commandCount;
+    }
+
+    const LinearAllocator& getAllocator() const {
+	return allocator;
+    }
+
+    // Returns false if the program was already bound
+    bool bindProgram(GLuint program) {
+	if (program == boundProgram) {
+	    return false;
+	}
+	push<BindProgramCommand>(CommandType::BindProgram).program = program;
+	boundProgram = program;
+	return true;
+    }
+
+    void bindVertexArray(GLuint vertexArray) {
+	if (vertexArray == boundVertexArray) {
+	    return;
+	}
+	push<BindVertexArrayCommand>(CommandType::BindVertexArray).vertexArray = vertexArray;
+	boundVertexArray = vertexArray;
+    }
+
+    void setUniform(GLint location, float value) {
+	auto& command = push<SetUniformFloatCommand>(CommandType::SetUniformFloat);
+	command.location = location;
+	command.value = value;
+    }
+
+    void drawIndexedInstanced(GLenum indexType, GLsizei indexCount, GLintptr indexOffset, GLsizei instanceCount, GLuint baseInstance = 0) {
+	auto& command = push<DrawIndexedInstancedCommand>(CommandType::DrawIndexedInstanced);
+	command.indexType = indexType;
+	command.indexCount = indexCount;
+	command.indexOffset = indexOffset;
+	command.instanceCount = instanceCount;
+	command.baseInstance = baseInstance;
+    }
+};
+
+// Executes a recorded buffer on the calling thread, which must own the GL
+// context. Leaves the last program and vertex array bound.
+inline void replay(const CommandBuffer& buffer) {
+    const auto& chunks = buffer.getAllocator().getChunks();
+
+    for (size_t c = 0; c < buffer.getAllocator().usedChunks(); ++c) {
+	const uint8_t* data = chunks[c].data.get();
+	size_t offset = 0;
+
+	while (offset < chunks[c].used) {
+	    const uint8_t* cursor = data + offset;
+	    const auto* header = reinterpret_cast<const CommandHeader*>(cursor);
+
+	    switch (header->type) {
+		case CommandType::BindProgram: {
+		    auto* command = reinterpret_cast<const BindProgramCommand*>(cursor);
+		    glUseProgram(command->program);
+		    break;
+		}
+		case CommandType::BindVertexArray: {
+		    auto* command = reinterpret_cast<const BindVertexArrayCommand*>(cursor);
+		    glBindVertexArray(command->vertexArray);
+		    break;
+		}
+		case CommandType::SetUniformFloat: {
+		    auto* command = reinterpret_cast<const SetUniformFloatCommand*>(cursor);
+		    glUniform1f(command->location, command->value);
+		    break;
+		}
+		case CommandType::DrawIndexedInstanced: {
+		    auto* command = reinterpret_cast<const DrawIndexedInstancedCommand*>(cursor);
+		    glDrawElementsInstancedBaseInstance(
+			GL_TRIANGLES, command->indexCount, command->indexType,
+			(void*)command->indexOffset, command->instanceCount, command->baseInstance
+		    );
+		    break;
+		}
+	    }
+
+	    offset = (offset + header->size + commandAlignment - 1) & ~(commandAlignment - 1);
+	}
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+enum class SwapMode {
+    Off,        // present immediately, tearing allowed: lowest latency
+    On,         // wait for vblank: no tearing, up to a refresh of latency
+    Adaptive    // wait for vblank unless the frame is late, then tear
+};
+
+inline bool parseSwapMode(const std::string& name, SwapMode& mode) {
+    if (name == "off") {
+	mode = SwapMode::Off;
+    } else if (name == "on") {
+	mode = SwapMode::On;
+    } else if (name == "adaptive") {
+	mode = SwapMode::Adaptive;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+// Sets the swap interval of the current context explicitly rather than
+// relying on the driver default. Adaptive vsync needs the swap_control_tear
+// extension; without it this falls back to plain vsync.
+inline SwapMode applySwapMode(SwapMode mode) {
+    if (mode == SwapMode::Adaptive
+	&& !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+	&& !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+	std::cerr << "WARNING::SWAP::ADAPTIVE_UNSUPPORTED falling back to vsync" << std::endl;
+	mode = SwapMode::On;
+    }
+
+    switch (mode) {
+	case SwapMode::Off:
+	    glfwSwapInterval(0);
+	    break;
+	case SwapMode::On:
+	    glfwSwapInterval(1);
+	    break;
+	case SwapMode::Adaptive:
+	    glfwSwapInterval(-1);
+	    break;
+    }
+    return mode;
+}
+
+// Caps the frame rate by holding each frame until its slot. The OS sleep
+// only covers all but the last spinMargin, which is then spun away: sleeps
+// overshoot by up to a scheduler tick, which at high rates is a sizeable
+// part of the frame. A frame that runs late starts the schedule over
+// instead of rushing the following ones to catch up.
+class FrameLimiter {
+private:
+    static constexpr std::chrono::microseconds spinMargin{1500};
+
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point next;
+
+public:
+    // A rate of 0 disables the limiter
+    explicit FrameLimiter(float fps)
+        : interval{fps > 0.0f
+                ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps))
+                : std::chrono::steady_clock::duration::zero()},
+          next{std::chrono::steady_clock::now()}
+    {}
+
+    bool enabled() const {
+	return interval != std::chrono::steady_clock::duration::zero();
+    }
+
+    // Returns once the current frame may start
+    void wait() {
+	if (!enabled()) {
+	    return;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (next - now > spinMargin) {
+	    std::this_thread::sleep_until(next - spinMargin);
+	}
+	while ((now = std::chrono::steady_clock::now()) < next) {
+	    std::this_thread::yield();
+	}
+
+	next += interval;
+	if (next < now) {
+	    next = now + interval;
+	}
+    }
+};
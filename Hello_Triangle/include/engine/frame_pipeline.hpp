@@ -0,0 +1,188 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <ostream>
+#include <vector>
+
+// Everything the GL thread needs to submit one frame, produced by the
+// simulation thread. Rows are those of the scene's object list.
+//
+// The simulation advances in fixed steps and publishes its last two states;
+// the GL thread blends between them for the moment it renders. Most objects
+// usually stand still, so the earlier state is kept only for the rows the
+// last step moved, and the packet lists which rows the GL thread has to
+// send to the GPU again.
+struct FramePacket {
+    uint64_t frame;
+    uint64_t steps;     // simulation steps taken when it was filled
+    std::chrono::steady_clock::time_point simulatedAt;  // when the last step was due
+    float time;     // seconds of simulated time since the start
+    float step;     // seconds of simulated time between the two states
+    std::vector<glm::mat4> transforms;          // every row after the last step
+    std::vector<uint32_t> moved;                // rows the last step changed, ascending
+    std::vector<glm::mat4> previousTransforms;  // their matrices before it, one per moved row
+    std::vector<uint32_t> changed;              // rows changed since the packet the reader held when this one was filled, ascending
+    bool allChanged;                            // every row must be treated as changed instead
+};
+
+// Blends two rigid transforms. The basis columns are renormalized to the
+// blended length, so a rotation does not shrink the object half way.
+inline glm::mat4 interpolateTransform(const glm::mat4& from, const glm::mat4& to, float alpha) {
+    glm::mat4 result;
+
+    for (int c = 0; c < 3; ++c) {
+	glm::vec3 a(from[c]), b(to[c]);
+	glm::vec3 blended = a + (b - a) * alpha;
+	float length = glm::length(blended);
+	float target = glm::length(a) + (glm::length(b) - glm::length(a)) * alpha;
+
+	result[c] = glm::vec4(length > 0.0f ? blended * (target / length) : blended, 0.0f);
+    }
+    result[3] = from[3] + (to[3] - from[3]) * alpha;
+
+    return result;
+}
+
+// Triple-buffered hand-off between a simulation thread (writer) and the GL
+// thread (reader). The writer always has a packet to fill and never waits:
+// publishing replaces any packet the reader has not picked up yet. The
+// reader always gets the newest packet, or keeps the one it had when
+// nothing new was published, so rendering and simulation each run at their
+// own rate.
+class FramePipeline {
+private:
+    FramePacket packets[3];
+    int writing, ready, reading;
+    bool fresh;     // ready holds a packet the reader has not seen
+    bool started;   // the reader holds a packet
+    uint64_t nextFrame;
+    uint64_t readSteps; // steps of the newest packet the reader picked up
+    bool stopped;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+
+public:
+    FramePipeline()
+        : packets{},
+          writing{0},
+          ready{1},
+          reading{2},
+          fresh{false},
+          started{false},
+          nextFrame{0},
+          readSteps{0},
+          stopped{false}
+    {}
+
+    // Writer: the packet to fill. Returns nullptr once stopped.
+    FramePacket* beginWrite() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (stopped) {
+	    return nullptr;
+	}
+
+	packets[writing].frame = nextFrame++;
+	return &packets[writing];
+    }
+
+    // Publishes the packet, dropping an unread older one
+    void endWrite(FramePacket* packet) {
+	(void)packet;
+	{
+	    std::lock_guard<std::mutex> lock(mutex);
+	    std::swap(writing, ready);
+	    fresh = true;
+	}
+	changed.notify_all();
+    }
+
+    // Reader: the newest packet. Blocks only until the first one is
+    // published. Returns nullptr once stopped.
+    FramePacket* beginRead() {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] { return stopped || fresh || started; });
+
+	if (stopped) {
+	    return nullptr;
+	}
+
+	if (fresh) {
+	    std::swap(reading, ready);
+	    fresh = false;
+	    started = true;
+	    readSteps = packets[reading].steps;
+	}
+	return &packets[reading];
+    }
+
+    // Writer: the step count of the newest packet the reader has picked
+    // up. The reader may have moved on to a newer one by the time this
+    // returns, never to an older one. Returns false before the first.
+    bool lastRead(uint64_t& steps) {
+	std::lock_guard<std::mutex> lock(mutex);
+	steps = readSteps;
+	return started;
+    }
+
+    // The packet stays with the reader until a newer one replaces it in
+    // beginRead, so there is nothing to hand back
+    void endRead(FramePacket* packet) {
+	(void)packet;
+    }
+
+    void stop() {
+	{
+	    std::lock_guard<std::mutex> lock(mutex);
+	    stopped = true;
+	}
+	changed.notify_all();
+    }
+};
+
+// Running latency statistics, e.g. from the simulation step a frame shows
+// to the return of the buffer swap that presents it
+class LatencyStats {
+private:
+    double total;
+    double worst;
+    uint64_t count;
+
+public:
+    LatencyStats()
+        : total{0.0},
+          worst{0.0},
+          count{0}
+    {}
+
+    void record(std::chrono::steady_clock::duration latency) {
+	double ms = std::chrono::duration<double, std::milli>(latency).count();
+	total += ms;
+	worst = std::max(worst, ms);
+	++count;
+    }
+
+    double average() const {
+	return count ? total / count : 0.0;
+    }
+
+    double maximum() const {
+	return worst;
+    }
+
+    uint64_t frames() const {
+	return count;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const LatencyStats& stats) {
+    return os << "avg " << stats.average() << " ms, max " << stats.maximum()
+	      << " ms over " << stats.frames() << " frames";
+}
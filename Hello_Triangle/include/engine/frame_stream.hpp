@@ -0,0 +1,285 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <engine/gl_handle.hpp>
+#include <engine/shader.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class StreamFormat {
+    Rgba,       // 4 bytes per pixel, ffmpeg -pix_fmt rgba
+    Yuv420      // planar BT.601 limited range, 1.5 bytes per pixel, ffmpeg -pix_fmt yuv420p
+};
+
+inline bool parseStreamFormat(const std::string& name, StreamFormat& format) {
+    if (name == "rgba") {
+	format = StreamFormat::Rgba;
+    } else if (name == "yuv420") {
+	format = StreamFormat::Yuv420;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+// Converts an RGBA8 texture to I420 on the GPU, so only 1.5 bytes per pixel
+// have to cross the bus instead of 4. The planes are written to an R8
+// texture as one contiguous image in memory order: reading it back gives
+// the Y plane followed by the U and V planes, top row first, ready for an
+// encoder. Width and height must be even.
+class YuvConverter {
+private:
+    Texture planes;
+    Program program;
+    int width, height;
+
+    // One invocation per 2x2 block: four luma samples and one averaged
+    // chroma pair. Byte i of the output lives at texel (i % width, i / width).
+    static constexpr const char* computeSource = R"(
+#version 460 core
+layout (local_size_x = 8, local_size_y = 8) in;
+layout (binding = 0) uniform sampler2D source;
+layout (binding = 0, r8) writeonly uniform image2D planes;
+uniform ivec2 size;
+
+void storeByte(int index, float value)
+{
+    imageStore(planes, ivec2(index % size.x, index / size.x), vec4(value / 255.0f));
+}
+
+void main()
+{
+    ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+    if (block.x * 2 >= size.x || block.y * 2 >= size.y) {
+        return;
+    }
+
+    vec3 sum = vec3(0.0f);
+    for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+            // Output rows run top to bottom, GL rows bottom to top
+            int x = block.x * 2 + dx;
+            int y = block.y * 2 + dy;
+            vec3 rgb = texelFetch(source, ivec2(x, size.y - 1 - y), 0).rgb;
+
+            storeByte(y * size.x + x, 16.0f + dot(rgb, vec3(65.481f, 128.553f, 24.966f)));
+            sum += rgb;
+        }
+    }
+
+    vec3 rgb = sum * 0.25f;
+    int chroma = block.y * (size.x / 2) + block.x;
+    int lumaSize = size.x * size.y;
+    storeByte(lumaSize + chroma, 128.0f + dot(rgb, vec3(-37.797f, -74.203f, 112.0f)));
+    storeByte(lumaSize + lumaSize / 4 + chroma, 128.0f + dot(rgb, vec3(112.0f, -93.786f, -18.214f)));
+})";
+
+public:
+    YuvConverter()
+        : planes{Texture::create()},
+          program{createComputeProgram(computeSource)},
+          width{0},
+          height{0}
+    {}
+
+    bool isValid() const {
+	return static_cast<bool>(program);
+    }
+
+    // Converts level 0 of an RGBA texture of the given size. Returns the R8
+    // texture holding the planes, width wide and height * 3 / 2 tall.
+    GLuint convert(GLuint rgbaTexture, int newWidth, int newHeight) {
+	if (newWidth != width || newHeight != height) {
+	    width = newWidth;
+	    height = newHeight;
+
+	    glBindTexture(GL_TEXTURE_2D, planes.get());
+	    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height * 3 / 2, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	    glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	glUseProgram(program.get());
+	glUniform2i(glGetUniformLocation(program.get(), "size"), width, height);
+	glBindTextureUnit(0, rgbaTexture);
+	glBindImageTexture(0, planes.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+
+	glDispatchCompute((width / 2 + 7) / 8, (height / 2 + 7) / 8, 1);
+
+	// The planes are read back next
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glUseProgram(0);
+
+	return planes.get();
+    }
+
+    int getPlanesHeight() const {
+	return height * 3 / 2;
+    }
+};
+
+// Writes raw frames to stdout ("-") or a file such as a named pipe from a
+// thread of its own, so encoding overlaps rendering. At most depth frames
+// wait in memory; once all of them are taken push() waits for the writer
+// to free one, so a slow consumer throttles the renderer instead of losing
+// frames. With dropWhenFull such a frame is dropped and counted instead,
+// for live viewing where keeping up matters more than completeness.
+class FrameStream {
+private:
+    std::FILE* file;
+    bool ownsFile;
+
+    std::vector<std::vector<uint8_t>> free;
+    std::deque<std::vector<uint8_t>> queued;
+    uint64_t written;
+    uint64_t dropped;
+    bool failed;
+    bool stopping;
+    bool dropWhenFull;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread writer;
+
+    void write() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+	    changed.wait(lock, [this] { return stopping || !queued.empty(); });
+	    if (queued.empty()) {
+		return;
+	    }
+
+	    std::vector<uint8_t> frame = std::move(queued.front());
+	    queued.pop_front();
+
+	    lock.unlock();
+	    bool ok = std::fwrite(frame.data(), 1, frame.size(), file) == frame.size() && std::fflush(file) == 0;
+	    lock.lock();
+
+	    free.push_back(std::move(frame));
+	    changed.notify_all();
+	    if (ok) {
+		++written;
+	    } else {
+		// The reader went away; nothing queued can be delivered either
+		failed = true;
+		for (auto& pending : queued) {
+		    free.push_back(std::move(pending));
+		}
+		queued.clear();
+	    }
+	}
+    }
+
+public:
+    FrameStream(const std::string& path, size_t depth, bool dropWhenFull = false)
+        : file{nullptr},
+          ownsFile{false},
+          free(depth > 0 ? depth : 1),
+          queued{},
+          written{0},
+          dropped{0},
+          failed{false},
+          stopping{false},
+          dropWhenFull{dropWhenFull}
+    {
+        if (path == "-") {
+            file = stdout;
+        } else {
+            file = std::fopen(path.c_str(), "wb");
+            ownsFile = true;
+        }
+
+        if (file == nullptr) {
+            std::cerr << "ERROR::STREAM::OPEN_FAILED " << path << std::endl;
+            failed = true;
+            return;
+        }
+
+        writer = std::thread(&FrameStream::write, this);
+    }
+
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    // Writes out the frames still queued before closing
+    ~FrameStream() {
+	{
+	    std::lock_guard<std::mutex> lock(mutex);
+	    stopping = true;
+	}
+	changed.notify_all();
+
+	if (writer.joinable()) {
+	    writer.join();
+	}
+	if (file != nullptr && ownsFile) {
+	    std::fclose(file);
+	}
+    }
+
+    // Queues rowCount rows of rowSize bytes, row r starting at
+    // rows + r * rowStride. Waits while the queue is full unless frames
+    // are dropped then. Returns false if the frame was dropped because the
+    // queue is full or the stream has failed.
+    bool push(const uint8_t* rows, ptrdiff_t rowStride, size_t rowSize, int rowCount) {
+	std::vector<uint8_t> frame;
+	{
+	    std::unique_lock<std::mutex> lock(mutex);
+	    if (!dropWhenFull) {
+		changed.wait(lock, [this] { return failed || !free.empty(); });
+	    }
+	    if (failed || free.empty()) {
+		++dropped;
+		return false;
+	    }
+	    frame = std::move(free.back());
+	    free.pop_back();
+	}
+
+	frame.resize(rowSize * rowCount);
+	if (rowStride == (ptrdiff_t)rowSize) {
+	    std::memcpy(frame.data(), rows, frame.size());
+	} else {
+	    for (int r = 0; r < rowCount; ++r) {
+		std::memcpy(&frame[r * rowSize], rows + r * rowStride, rowSize);
+	    }
+	}
+
+	{
+	    std::lock_guard<std::mutex> lock(mutex);
+	    queued.push_back(std::move(frame));
+	}
+	changed.notify_all();
+	return true;
+    }
+
+    // The file could not be opened or the reader closed it
+    bool closed() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return failed;
+    }
+
+    uint64_t framesWritten() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return written;
+    }
+
+    uint64_t framesDropped() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return dropped;
+    }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <engine/gl_handle.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Offscreen color + depth target the scene is rendered into. The depth
+// attachment is a texture so other passes (e.g. OIT) can attach and test
+// against the same depth buffer, which the default framebuffer can't offer.
+class SceneFramebuffer {
+private:
+    Framebuffer FBO;
+    Texture colorTexture, depthTexture;
+    int width, height;
+
+public:
+    SceneFramebuffer()
+        : FBO{Framebuffer::create()},
+          colorTexture{Texture::create()},
+          depthTexture{Texture::create()},
+          width{0},
+          height{0}
+    {}
+
+    // Reallocates the attachments if the size changed. Returns true if it did.
+    bool resize(int newWidth, int newHeight) {
+	if (newWidth == width && newHeight == height) {
+	    return false;
+	}
+
+	width = newWidth;
+	height = newHeight;
+
+	glBindTexture(GL_TEXTURE_2D, colorTexture.get());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, depthTexture.get());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO.get());
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture.get(), 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture.get(), 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return true;
+    }
+
+    void bind() const {
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO.get());
+	glViewport(0, 0, width, height);
+    }
+
+    // Copies the color attachment to the window's framebuffer
+    void blitToDefault() const {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO.get());
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Reads the color attachment back as tightly packed RGB, rows top to
+    // bottom. Waits for rendering to finish.
+    void readColor(std::vector<uint8_t>& rgb) const {
+	size_t rowSize = (size_t)width * 3;
+	std::vector<uint8_t> flipped(rowSize * height);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTextureImage(colorTexture.get(), 0, GL_RGB, GL_UNSIGNED_BYTE, flipped.size(), flipped.data());
+
+	rgb.resize(flipped.size());
+	for (int y = 0; y < height; ++y) {
+	    std::copy_n(&flipped[(size_t)(height - 1 - y) * rowSize], rowSize, &rgb[(size_t)y * rowSize]);
+	}
+    }
+
+    GLuint getColorTexture() const {
+	return colorTexture.get();
+    }
+
+    GLuint getDepthTexture() const {
+	return depthTexture.get();
+    }
+
+    int getWidth() const {
+	return width;
+    }
+
+    int getHeight() const {
+	return height;
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <utility>
+
+// Move-only owner of a GL object name. Traits provide create() and
+// destroy(GLuint); the object is destroyed when the handle goes out of scope,
+// so handles must not outlive the context (or share group) that created them.
+template <typename Traits>
+class GlHandle {
+private:
+    GLuint id;
+
+public:
+    GlHandle()
+        : id{0}
+    {}
+
+    explicit GlHandle(GLuint id)
+        : id{id}
+    {}
+
+    GlHandle(const GlHandle&) = delete;
+    GlHandle& operator=(const GlHandle&) = delete;
+
+    GlHandle(GlHandle&& other) noexcept
+        : id{other.release()}
+    {}
+
+    GlHandle& operator=(GlHandle&& other) noexcept {
+	if (this != &other) {
+	    reset(other.release());
+	}
+	return *this;
+    }
+
+    ~GlHandle() {
+	reset();
+    }
+
+    static GlHandle create() {
+	return GlHandle(Traits::create());
+    }
+
+    GLuint get() const {
+	return id;
+    }
+
+    explicit operator bool() const {
+	return id != 0;
+    }
+
+    // Gives up ownership without destroying the object
+    GLuint release() {
+	return std::exchange(id, 0);
+    }
+
+    void reset(GLuint newId = 0) {
+	if (id != 0) {
+	    Traits::destroy(id);
+	}
+	id = newId;
+    }
+};
+
+struct VertexArrayTraits {
+    static GLuint create() { GLuint id; glGenVertexArrays(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct BufferTraits {
+    static GLuint create() { GLuint id; glCreateBuffers(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteBuffers(1, &id); }
+};
+
+struct TextureTraits {
+    static GLuint create() { GLuint id; glGenTextures(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteTextures(1, &id); }
+};
+
+struct FramebufferTraits {
+    static GLuint create() { GLuint id; glGenFramebuffers(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteFramebuffers(1, &id); }
+};
+
+struct QueryTraits {
+    static GLuint create() { GLuint id; glGenQueries(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteQueries(1, &id); }
+};
+
+struct ShaderTraits {
+    static void destroy(GLuint id) { glDeleteShader(id); }
+};
+
+struct ProgramTraits {
+    static GLuint create() { return glCreateProgram(); }
+    static void destroy(GLuint id) { glDeleteProgram(id); }
+};
+
+using VertexArray = GlHandle<VertexArrayTraits>;
+using Buffer = GlHandle<BufferTraits>;
+using Texture = GlHandle<TextureTraits>;
+using Framebuffer = GlHandle<FramebufferTraits>;
+using Query = GlHandle<QueryTraits>;
+using Shader = GlHandle<ShaderTraits>;
+using Program = GlHandle<ProgramTraits>;
+
+// Move-only owner of a fence sync object
+class Fence {
+private:
+    GLsync sync;
+
+public:
+    Fence()
+        : sync{nullptr}
+    {}
+
+    Fence(const Fence&) = delete;
+    Fence& operator=(const Fence&) = delete;
+
+    Fence(Fence&& other) noexcept
+        : sync{std::exchange(other.sync, nullptr)}
+    {}
+
+    Fence& operator=(Fence&& other) noexcept {
+	if (this != &other) {
+	    reset();
+	    sync = std::exchange(other.sync, nullptr);
+	}
+	return *this;
+    }
+
+    ~Fence() {
+	reset();
+    }
+
+    // Inserts a fence after every command issued so far
+    static Fence insert() {
+	Fence fence;
+	fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	return fence;
+    }
+
+    explicit operator bool() const {
+	return sync != nullptr;
+    }
+
+    // Non-blocking check
+    bool signaled() const {
+	GLenum status = glClientWaitSync(sync, 0, 0);
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+
+    // Blocks until the fence signals, flushing so it can
+    void wait() const {
+	while (glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    }
+
+    void reset() {
+	if (sync != nullptr) {
+	    glDeleteSync(sync);
+	    sync = nullptr;
+	}
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <engine/gl_handle.hpp>
+#include <engine/tlsf.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// A sub-allocated range inside one of an arena's buffers
+struct GpuRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+    uint32_t block;
+    uint32_t node;
+
+    bool isValid() const {
+	return node != TlsfAllocator::invalid;
+    }
+};
+
+struct GpuArenaStats {
+    size_t blocks;
+    size_t allocations;
+    uint64_t reserved;
+    uint64_t used;
+    uint64_t largestFree;
+    size_t freeRanges;
+
+    // 0 when all free space is one contiguous range, approaching 1 as it
+    // splinters into many small holes
+    float fragmentation() const {
+	uint64_t free = reserved - used;
+	return free ? 1.0f - (float)largestFree / (float)free : 0.0f;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const GpuArenaStats& stats) {
+    return os << stats.allocations << " allocations in " << stats.blocks << " blocks, "
+	      << (stats.used >> 10) << " / " << (stats.reserved >> 10) << " KiB used, "
+	      << stats.freeRanges << " free ranges, fragmentation " << stats.fragmentation();
+}
+
+// Reserves large immutable glBufferStorage blocks and hands out ranges of
+// them with a TLSF allocator, so thousands of meshes cost a handful of GL
+// buffer objects. Vertex and index data share the same blocks; a mesh is
+// just (buffer, offset, count). Not thread-safe: allocate and free on one
+// thread, although any context sharing objects may write into the ranges.
+// The blocks are released with the arena, so it must outlive its meshes.
+class GpuBufferArena {
+private:
+    struct Block {
+	Buffer buffer;
+	TlsfAllocator allocator;
+    };
+
+    std::vector<Block> blocks;
+    GLsizeiptr blockSize;
+    GLsizeiptr alignment;
+
+public:
+    // Offsets are aligned to 256 bytes, which satisfies every index type and
+    // the strictest common GL_*_BUFFER_OFFSET_ALIGNMENT
+    GpuBufferArena(GLsizeiptr blockSize = 64 << 20, GLsizeiptr alignment = 256)
+        : blocks{},
+          blockSize{blockSize},
+          alignment{alignment}
+    {}
+
+    GpuBufferArena(const GpuBufferArena&) = delete;
+    GpuBufferArena& operator=(const GpuBufferArena&) = delete;
+
+    // Allocates from the first block with room, reserving a new block (at
+    // least size large) if none has
+    GpuRange allocate(GLsizeiptr size) {
+	for (size_t i = 0; i < blocks.size(); ++i) {
+	    TlsfAllocator::Allocation allocation = blocks[i].allocator.allocate(size);
+	    if (allocation.node != TlsfAllocator::invalid) {
+		return { blocks[i].buffer.get(), (GLintptr)allocation.offset, size, (uint32_t)i, allocation.node };
+	    }
+	}
+
+	GLsizeiptr reserve = std::max(blockSize, (size + alignment - 1) & ~(alignment - 1));
+
+	Buffer buffer = Buffer::create();
+	GLuint name = buffer.get();
+	glNamedBufferStorage(name, reserve, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	blocks.push_back({ std::move(buffer), TlsfAllocator(reserve, alignment) });
+
+	TlsfAllocator::Allocation allocation = blocks.back().allocator.allocate(size);
+	return { name, (GLintptr)allocation.offset, size, (uint32_t)(blocks.size() - 1), allocation.node };
+    }
+
+    void free(const GpuRange& range) {
+	if (!range.isValid()) {
+	    return;
+	}
+
+	blocks[range.block].allocator.free({ (uint64_t)range.offset, (uint64_t)range.size, range.node });
+    }
+
+    void upload(const GpuRange& range, const void* data, GLsizeiptr size) {
+	glNamedBufferSubData(range.buffer, range.offset, std::min(size, range.size), data);
+    }
+
+    GpuArenaStats stats() const {
+	GpuArenaStats stats{};
+	stats.blocks = blocks.size();
+
+	for (const auto& block : blocks) {
+	    size_t freeRanges = 0;
+	    uint64_t largest = block.allocator.largestFreeBlock(&freeRanges);
+
+	    stats.allocations += block.allocator.getAllocationCount();
+	    stats.reserved += block.allocator.getCapacity();
+	    stats.used += block.allocator.getCapacity() - block.allocator.getFreeBytes();
+	    stats.largestFree = std::max(stats.largestFree, largest);
+	    stats.freeRanges += freeRanges;
+	}
+
+	return stats;
+    }
+};
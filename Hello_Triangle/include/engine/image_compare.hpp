@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 8-bit RGB image, rows top to bottom
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;
+};
+
+// 64-bit FNV-1a over the size and pixels. Equal hashes are taken as an
+// exact match, anything else goes through the perceptual comparison.
+inline uint64_t hashImage(const Image& image) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto mix = [&hash](uint8_t byte) {
+	hash ^= byte;
+	hash *= 0x100000001B3ull;
+    };
+
+    for (int shift = 0; shift < 32; shift += 8) {
+	mix((uint8_t)(image.width >> shift));
+	mix((uint8_t)(image.height >> shift));
+    }
+    for (uint8_t byte : image.rgb) {
+	mix(byte);
+    }
+    return hash;
+}
+
+// Binary PPM (P6), readable by every image tool and trivial to parse.
+// Row y of the image starts at rows + y * rowStride; a negative stride
+// writes bottom-up memory, such as GL's, without flipping it first.
+inline bool writePpm(const std::string& path, int width, int height, const uint8_t* rows, ptrdiff_t rowStride) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+	std::cerr << "ERROR::IMAGE::OPEN_FAILED " << path << std::endl;
+	return false;
+    }
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+    for (int y = 0; y < height; ++y) {
+	file.write(reinterpret_cast<const char*>(rows + y * rowStride), (std::streamsize)width * 3);
+    }
+    return (bool)file;
+}
+
+inline bool writePpm(const std::string& path, const Image& image) {
+    return writePpm(path, image.width, image.height, image.rgb.data(), (ptrdiff_t)image.width * 3);
+}
+
+inline bool readPpm(const std::string& path, Image& image) {
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    int maxValue = 0;
+
+    if (!(file >> magic >> image.width >> image.height >> maxValue) || magic != "P6" || maxValue != 255) {
+	std::cerr << "ERROR::IMAGE::NOT_A_PPM " << path << std::endl;
+	return false;
+    }
+    file.get();
+
+    image.rgb.resize((size_t)image.width * image.height * 3);
+    file.read(reinterpret_cast<char*>(image.rgb.data()), image.rgb.size());
+    if (!file) {
+	std::cerr << "ERROR::IMAGE::TRUNCATED " << path << std::endl;
+	return false;
+    }
+    return true;
+}
+
+struct ImageDiff {
+    float maxDeltaE = 0.0f;
+    size_t differingPixels = 0;
+    size_t totalPixels = 0;
+
+    float differingFraction() const {
+	return totalPixels == 0 ? 0.0f : (float)differingPixels / (float)totalPixels;
+    }
+};
+
+// sRGB to CIE L*a*b* (D65)
+inline void srgbToLab(const uint8_t* rgb, float lab[3]) {
+    float linear[3];
+    for (int i = 0; i < 3; ++i) {
+	float c = rgb[i] / 255.0f;
+	linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float xyz[3] = {
+	(0.4124f * linear[0] + 0.3576f * linear[1] + 0.1805f * linear[2]) / 0.95047f,
+	(0.2126f * linear[0] + 0.7152f * linear[1] + 0.0722f * linear[2]),
+	(0.0193f * linear[0] + 0.1192f * linear[1] + 0.9505f * linear[2]) / 1.08883f
+    };
+
+    for (float& v : xyz) {
+	v = v > 0.008856f ? std::cbrt(v) : 7.787f * v + 16.0f / 116.0f;
+    }
+
+    lab[0] = 116.0f * xyz[1] - 16.0f;
+    lab[1] = 500.0f * (xyz[0] - xyz[1]);
+    lab[2] = 200.0f * (xyz[1] - xyz[2]);
+}
+
+inline float deltaE(const uint8_t* p, const uint8_t* q) {
+    float labP[3], labQ[3];
+    srgbToLab(p, labP);
+    srgbToLab(q, labQ);
+    return std::sqrt(
+	(labP[0] - labQ[0]) * (labP[0] - labQ[0])
+	+ (labP[1] - labQ[1]) * (labP[1] - labQ[1])
+	+ (labP[2] - labQ[2]) * (labP[2] - labQ[2])
+    );
+}
+
+// Smallest distance between pixel (x, y) of a and the 3x3 neighbourhood
+// around the same pixel of b
+inline float closestInNeighbourhood(const Image& a, const Image& b, int x, int y) {
+    const uint8_t* pixel = &a.rgb[((size_t)y * a.width + x) * 3];
+    float best = INFINITY;
+
+    for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, b.height - 1); ++ny) {
+	for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, b.width - 1); ++nx) {
+	    best = std::min(best, deltaE(pixel, &b.rgb[((size_t)ny * b.width + nx) * 3]));
+	}
+    }
+    return best;
+}
+
+// Perceptual comparison: a pixel differs when its CIE76 colour distance
+// exceeds threshold (2.3 is about one just noticeable difference). A pixel
+// whose colour appears among the other image's neighbours, in both
+// directions, is forgiven, so one-pixel shifts of rasterized edges do not
+// count while a wrong pixel still does.
+inline ImageDiff compareImages(const Image& a, const Image& b, float threshold = 2.3f) {
+    ImageDiff diff;
+
+    if (a.width != b.width || a.height != b.height) {
+	diff.totalPixels = diff.differingPixels = std::max((size_t)a.width * a.height, (size_t)b.width * b.height);
+	diff.maxDeltaE = INFINITY;
+	return diff;
+    }
+
+    diff.totalPixels = (size_t)a.width * a.height;
+
+    for (int y = 0; y < a.height; ++y) {
+	for (int x = 0; x < a.width; ++x) {
+	    size_t index = ((size_t)y * a.width + x) * 3;
+	    if (a.rgb[index] == b.rgb[index] && a.rgb[index + 1] == b.rgb[index + 1] && a.rgb[index + 2] == b.rgb[index + 2]) {
+		continue;
+	    }
+
+	    float best = std::max(
+		closestInNeighbourhood(a, b, x, y),
+		closestInNeighbourhood(b, a, x, y)
+	    );
+
+	    diff.maxDeltaE = std::max(diff.maxDeltaE, best);
+	    if (best > threshold) {
+		++diff.differingPixels;
+	    }
+	}
+    }
+
+    return diff;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <engine/gl_handle.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Shader storage buffer holding one element per instance, such as a mat4 or
+// an object index, indexed by gl_InstanceID in the vertex shader. Refilled
+// every frame.
+class InstanceBuffer {
+private:
+    Buffer SSBO;
+    size_t capacity;
+
+public:
+    InstanceBuffer()
+        : SSBO{Buffer::create()},
+          capacity{0}
+    {}
+
+    template <typename T>
+    void upload(const std::vector<T>& items) {
+	size_t bytes = items.size() * sizeof(T);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO.get());
+
+	// Orphan the previous storage so we never wait on draws still reading it
+	if (bytes > capacity) {
+	    capacity = bytes;
+	}
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, items.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void bind(GLuint binding) const {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, SSBO.get());
+    }
+};
+
+// Shader storage buffer holding the model matrix of every scene row, kept
+// on the GPU from frame to frame. In a mostly static scene few rows change,
+// so only those are sent again: neighbouring changed rows are coalesced into
+// runs, with short gaps of unchanged rows taken along to save calls, and
+// each run is one glNamedBufferSubData.
+class TransformBuffer {
+private:
+    // Most unchanged rows re-sent to join two runs rather than starting
+    // another call
+    static constexpr uint32_t maxGap = 4;
+
+    Buffer SSBO;
+    size_t count;
+    uint64_t bytesUploaded;
+
+public:
+    TransformBuffer()
+        : SSBO{},
+          count{0},
+          bytesUploaded{0}
+    {}
+
+    // Sends every row, reallocating if the row count changed
+    void upload(const std::vector<glm::mat4>& transforms) {
+	if (transforms.size() != count || !SSBO) {
+	    count = transforms.size();
+	    SSBO = Buffer::create();
+	    glNamedBufferStorage(SSBO.get(), std::max<size_t>(count, 1) * sizeof(glm::mat4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+	glNamedBufferSubData(SSBO.get(), 0, count * sizeof(glm::mat4), transforms.data());
+	bytesUploaded += count * sizeof(glm::mat4);
+    }
+
+    // Sends the given rows, ascending, of transforms. Falls back to a full
+    // upload if the row count changed.
+    void update(const std::vector<glm::mat4>& transforms, const std::vector<uint32_t>& rows) {
+	if (transforms.size() != count || !SSBO) {
+	    upload(transforms);
+	    return;
+	}
+
+	size_t i = 0;
+	while (i < rows.size()) {
+	    uint32_t first = rows[i];
+	    uint32_t last = first;
+	    while (++i < rows.size() && rows[i] - last <= maxGap + 1) {
+		last = rows[i];
+	    }
+
+	    size_t bytes = (size_t)(last - first + 1) * sizeof(glm::mat4);
+	    glNamedBufferSubData(SSBO.get(), first * sizeof(glm::mat4), bytes, &transforms[first]);
+	    bytesUploaded += bytes;
+	}
+    }
+
+    void bind(GLuint binding) const {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, SSBO.get());
+    }
+
+    // Bytes sent so far
+    uint64_t uploaded() const {
+	return bytesUploaded;
+    }
+};
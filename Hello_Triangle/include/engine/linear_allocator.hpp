@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bump allocator over a list of fixed-size chunks. Individual allocations are
+// never freed; reset() rewinds everything at once and keeps the chunks, so
+// after warm-up a frame's allocations touch no heap at all. Not thread-safe;
+// give each thread its own.
+class LinearAllocator {
+public:
+    struct Chunk {
+	std::unique_ptr<uint8_t[]> data;
+	size_t capacity;
+	size_t used;
+    };
+
+private:
+    std::vector<Chunk> chunks;
+    size_t current;
+    size_t chunkSize;
+
+public:
+    explicit LinearAllocator(size_t chunkSize = 64 << 10)
+        : chunks{},
+          current{0},
+          chunkSize{chunkSize}
+    {}
+
+    // Returns size bytes aligned to alignment (a power of two, at most 16).
+    // Offsets within a chunk are aligned, and chunks start 16-byte aligned.
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+	while (true) {
+	    if (current == chunks.size()) {
+		size_t capacity = std::max(size, chunkSize);
+		chunks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[capacity]), capacity, 0 });
+	    }
+
+	    Chunk& chunk = chunks[current];
+	    size_t offset = (chunk.used + alignment - 1) & ~(alignment - 1);
+
+	    if (offset + size <= chunk.capacity) {
+		chunk.used = offset + size;
+		return chunk.data.get() + offset;
+	    }
+
+	    ++current;
+	}
+    }
+
+    void reset() {
+	for (auto& chunk : chunks) {
+	    chunk.used = 0;
+	}
+	current = 0;
+    }
+
+    // Chunks in allocation order; only the first usedChunks() hold data
+    const std::vector<Chunk>& getChunks() const {
+	return chunks;
+    }
+
+    size_t usedChunks() const {
+	return chunks.empty() ? 0 : current + 1;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// How a material wants its fragments combined with the color buffer.
+// Opaque materials are drawn with blending disabled; translucent ones are
+// drawn afterwards into the weighted blended OIT targets, in any order,
+// depth tested against the opaque pass but without writing depth.
+enum class BlendMode {
+    Opaque,
+    Translucent
+};
+
+struct Material {
+    GLuint program;
+    BlendMode blendMode;
+    float alpha;
+    GLint uniAlpha;
+
+    // Program 0 makes a material that only describes blending, for the
+    // software rasterizer, and needs no GL context
+    Material(GLuint program, BlendMode blendMode, float alpha = 1.0f)
+        : program{program},
+          blendMode{blendMode},
+          alpha{blendMode == BlendMode::Opaque ? 1.0f : alpha},
+          uniAlpha{program != 0 ? glGetUniformLocation(program, "alpha") : -1}
+    {}
+
+    bool isTranslucent() const {
+	return blendMode == BlendMode::Translucent;
+    }
+
+    void bind() const {
+	glUseProgram(program);
+	glUniform1f(uniAlpha, alpha);
+    }
+};
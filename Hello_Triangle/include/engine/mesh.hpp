@@ -0,0 +1,360 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <engine/command_buffer.hpp>
+#include <engine/gpu_arena.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// How vertex positions are stored in the vertex buffer
+enum class PositionFormat : uint8_t {
+    Float32,    // 3 x GL_FLOAT, 12 bytes
+    HalfFloat,  // 4 x GL_HALF_FLOAT (w padding), 8 bytes
+    Snorm10     // GL_INT_2_10_10_10_REV normalized, 4 bytes; positions must lie in [-1, 1]
+};
+
+// How vertex colors are stored in the vertex buffer
+enum class ColorFormat : uint8_t {
+    Float32,    // 3 x GL_FLOAT, 12 bytes
+    Unorm8      // 4 x GL_UNSIGNED_BYTE normalized RGBA, 4 bytes
+};
+
+struct VertexFormat {
+    PositionFormat position = PositionFormat::Float32;
+    ColorFormat color = ColorFormat::Float32;
+
+    // 8-bit indices save little over 16-bit and many GPUs widen them in the
+    // driver, so they're only picked when asked for
+    bool allowByteIndices = false;
+
+    GLsizei positionSize() const {
+	switch (position) {
+	    case PositionFormat::HalfFloat: return 4 * sizeof(uint16_t);
+	    case PositionFormat::Snorm10:   return sizeof(uint32_t);
+	    default:                        return 3 * sizeof(float);
+	}
+    }
+
+    GLsizei colorSize() const {
+	return color == ColorFormat::Unorm8 ? sizeof(uint32_t) : 3 * sizeof(float);
+    }
+
+    GLsizei stride() const {
+	return positionSize() + colorSize();
+    }
+};
+
+// Smallest index type able to address vertexCount vertices
+inline GLenum chooseIndexType(size_t vertexCount, bool allowByteIndices = false) {
+    if (allowByteIndices && vertexCount <= 0x100) {
+	return GL_UNSIGNED_BYTE;
+    }
+    if (vertexCount <= 0x10000) {
+	return GL_UNSIGNED_SHORT;
+    }
+    return GL_UNSIGNED_INT;
+}
+
+inline size_t indexTypeSize(GLenum indexType) {
+    switch (indexType) {
+	case GL_UNSIGNED_BYTE:  return sizeof(uint8_t);
+	case GL_UNSIGNED_SHORT: return sizeof(uint16_t);
+	default:                return sizeof(uint32_t);
+    }
+}
+
+// CPU-side mesh: one position and color per vertex plus a triangle list
+struct MeshData {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors;
+    std::vector<uint32_t> indices;
+};
+
+// Interleaves and packs the vertex attributes of a mesh into the given format
+inline std::vector<uint8_t> packVertices(const MeshData& data, const VertexFormat& format) {
+    std::vector<uint8_t> bytes(data.positions.size() * format.stride());
+    uint8_t* out = bytes.data();
+
+    for (size_t i = 0; i < data.positions.size(); ++i) {
+	const glm::vec3& p = data.positions[i];
+	const glm::vec3& c = data.colors[i];
+
+	switch (format.position) {
+	    case PositionFormat::HalfFloat: {
+		const uint16_t half[4] = {
+		    glm::packHalf1x16(p.x),
+		    glm::packHalf1x16(p.y),
+		    glm::packHalf1x16(p.z),
+		    glm::packHalf1x16(1.0f)
+		};
+		std::memcpy(out, half, sizeof(half));
+		break;
+	    }
+	    case PositionFormat::Snorm10: {
+		uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4(p, 1.0f));
+		std::memcpy(out, &packed, sizeof(packed));
+		break;
+	    }
+	    default:
+		std::memcpy(out, &p, sizeof(p));
+		break;
+	}
+	out += format.positionSize();
+
+	if (format.color == ColorFormat::Unorm8) {
+	    uint32_t packed = glm::packUnorm4x8(glm::vec4(c, 1.0f));
+	    std::memcpy(out, &packed, sizeof(packed));
+	} else {
+	    std::memcpy(out, &c, sizeof(c));
+	}
+	out += format.colorSize();
+    }
+
+    return bytes;
+}
+
+// Narrows 32-bit indices to the given index type
+inline std::vector<uint8_t> packIndices(const std::vector<uint32_t>& indices, GLenum indexType) {
+    size_t size = indexTypeSize(indexType);
+    std::vector<uint8_t> bytes(indices.size() * size);
+
+    for (size_t i = 0; i < indices.size(); ++i) {
+	switch (indexType) {
+	    case GL_UNSIGNED_BYTE: {
+		bytes[i] = static_cast<uint8_t>(indices[i]);
+		break;
+	    }
+	    case GL_UNSIGNED_SHORT: {
+		uint16_t index = static_cast<uint16_t>(indices[i]);
+		std::memcpy(&bytes[i * size], &index, size);
+		break;
+	    }
+	    default:
+		std::memcpy(&bytes[i * size], &indices[i], size);
+		break;
+	}
+    }
+
+    return bytes;
+}
+
+// Whether every one of indexCount packed indices addresses one of
+// vertexCount vertices
+template <typename Index>
+bool indicesInRange(const void* indices, size_t indexCount, uint64_t vertexCount) {
+    const Index* typed = static_cast<const Index*>(indices);
+    for (size_t i = 0; i < indexCount; ++i) {
+	if (typed[i] >= vertexCount) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+inline bool indicesInRange(const void* indices, GLenum indexType, size_t indexCount, uint64_t vertexCount) {
+    switch (indexType) {
+	case GL_UNSIGNED_BYTE:  return indicesInRange<uint8_t>(indices, indexCount, vertexCount);
+	case GL_UNSIGNED_SHORT: return indicesInRange<uint16_t>(indices, indexCount, vertexCount);
+	default:                return indicesInRange<uint32_t>(indices, indexCount, vertexCount);
+    }
+}
+
+// Points attributes 0 (position) and 1 (color) of the bound VAO at the bound
+// GL_ARRAY_BUFFER, laid out as produced by packVertices()
+inline void setupVertexAttributes(const VertexFormat& format, GLintptr baseOffset = 0) {
+    GLsizei stride = format.stride();
+    const void* positionOffset = (void*)baseOffset;
+    const void* colorOffset = (void*)(baseOffset + format.positionSize());
+
+    switch (format.position) {
+	case PositionFormat::HalfFloat:
+	    glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, stride, positionOffset);
+	    break;
+	case PositionFormat::Snorm10:
+	    glVertexAttribPointer(0, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, positionOffset);
+	    break;
+	default:
+	    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, positionOffset);
+	    break;
+    }
+    glEnableVertexAttribArray(0);
+
+    if (format.color == ColorFormat::Unorm8) {
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, colorOffset);
+    } else {
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, colorOffset);
+    }
+    glEnableVertexAttribArray(1);
+}
+
+// GPU mesh: ranges of a GpuBufferArena holding interleaved vertices and
+// indices of the narrowest type the vertex count allows, plus a VAO over them.
+// Move-only; the ranges go back to the arena when the mesh is destroyed.
+class Mesh {
+private:
+    GpuBufferArena* arena;
+    GpuRange vertices, indices;
+    VertexArray VAO;
+    GLenum indexType;
+    GLsizei indexCount;
+    VertexFormat format;
+
+public:
+    Mesh()
+        : arena{nullptr},
+          vertices{0, 0, 0, 0, TlsfAllocator::invalid},
+          indices{0, 0, 0, 0, TlsfAllocator::invalid},
+          VAO{},
+          indexType{GL_UNSIGNED_INT},
+          indexCount{0},
+          format{}
+    {}
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh&& other) noexcept
+        : arena{std::exchange(other.arena, nullptr)},
+          vertices{other.vertices},
+          indices{other.indices},
+          VAO{std::move(other.VAO)},
+          indexType{other.indexType},
+          indexCount{other.indexCount},
+          format{other.format}
+    {}
+
+    Mesh& operator=(Mesh&& other) noexcept {
+	if (this != &other) {
+	    release();
+	    arena = std::exchange(other.arena, nullptr);
+	    vertices = other.vertices;
+	    indices = other.indices;
+	    VAO = std::move(other.VAO);
+	    indexType = other.indexType;
+	    indexCount = other.indexCount;
+	    format = other.format;
+	}
+	return *this;
+    }
+
+    ~Mesh() {
+	release();
+    }
+
+    Mesh(GpuBufferArena& arena, const MeshData& data, const VertexFormat& format = VertexFormat{})
+        : Mesh()
+    {
+        GLenum type = chooseIndexType(data.positions.size(), format.allowByteIndices);
+
+        std::vector<uint8_t> vertexBytes = packVertices(data, format);
+        std::vector<uint8_t> indexBytes = packIndices(data.indices, type);
+
+        *this = reserve(arena, vertexBytes.size(), data.indices.size(), type, format);
+        arena.upload(vertices, vertexBytes.data(), vertexBytes.size());
+        arena.upload(indices, indexBytes.data(), indexBytes.size());
+        createVertexArray();
+    }
+
+    // Uploads already packed vertex and index data, e.g. straight from a
+    // memory-mapped file
+    Mesh(GpuBufferArena& arena,
+         const void* vertexBytes, size_t vertexSize,
+         const void* indexBytes, GLsizei indexCount, GLenum indexType,
+         const VertexFormat& format)
+        : Mesh()
+    {
+        *this = reserve(arena, vertexSize, indexCount, indexType, format);
+        arena.upload(vertices, vertexBytes, vertexSize);
+        arena.upload(indices, indexBytes, indexCount * indexTypeSize(indexType));
+        createVertexArray();
+    }
+
+    // Allocates the mesh's ranges without filling them, for data written
+    // elsewhere (e.g. by a loader thread). Call createVertexArray() once the
+    // data has landed.
+    static Mesh reserve(GpuBufferArena& arena, size_t vertexSize, GLsizei indexCount, GLenum indexType, const VertexFormat& format) {
+	Mesh mesh;
+	mesh.arena = &arena;
+	mesh.vertices = arena.allocate(vertexSize);
+	mesh.indices = arena.allocate(indexCount * indexTypeSize(indexType));
+	mesh.indexType = indexType;
+	mesh.indexCount = indexCount;
+	mesh.format = format;
+	return mesh;
+    }
+
+    // VAOs aren't shared between contexts, so this must run in the context
+    // that draws the mesh
+    void createVertexArray() {
+	VAO = VertexArray::create();
+	glBindVertexArray(VAO.get());
+	glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.buffer);
+	setupVertexAttributes(format, vertices.offset);
+	glBindVertexArray(0);
+    }
+
+    // False for placeholder meshes whose data hasn't been uploaded yet
+    bool isReady() const {
+	return static_cast<bool>(VAO);
+    }
+
+    const GpuRange& getVertexRange() const {
+	return vertices;
+    }
+
+    const GpuRange& getIndexRange() const {
+	return indices;
+    }
+
+    GLenum getIndexType() const {
+	return indexType;
+    }
+
+    GLsizei getIndexCount() const {
+	return indexCount;
+    }
+
+    void bind() const {
+	glBindVertexArray(VAO.get());
+    }
+
+    void draw() const {
+	glBindVertexArray(VAO.get());
+	glDrawElements(GL_TRIANGLES, indexCount, indexType, (void*)indices.offset);
+	glBindVertexArray(0);
+    }
+
+    void drawInstanced(GLsizei instanceCount) const {
+	glBindVertexArray(VAO.get());
+	glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, (void*)indices.offset, instanceCount);
+	glBindVertexArray(0);
+    }
+
+    // Records a single instance with the given base instance, which shaders
+    // use through gl_BaseInstance to find the object's data, for replay on
+    // the GL thread. The vertex array stays bound so consecutive draws of
+    // one mesh share the bind.
+    void recordInstance(CommandBuffer& commands, GLuint baseInstance) const {
+	commands.bindVertexArray(VAO.get());
+	commands.drawIndexedInstanced(indexType, indexCount, (GLintptr)indices.offset, 1, baseInstance);
+    }
+
+private:
+    // Returns the ranges to the arena
+    void release() {
+	VAO.reset();
+
+	if (arena != nullptr) {
+	    arena->free(vertices);
+	    arena->free(indices);
+	    arena = nullptr;
+	}
+    }
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <engine/gl_handle.hpp>
+#include <engine/mesh.hpp>
+#include <engine/spsc_queue.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Packed mesh data waiting to be copied into ranges reserved with
+// Mesh::reserve(). The pointers must stay valid until the upload finished,
+// which storage guarantees (e.g. by owning the file mapping they point into).
+// Indices are checked against vertexCount before anything is copied; a
+// mesh with one out of range is never uploaded.
+struct MeshUploadJob {
+    uint64_t id;
+    GpuRange vertexTarget;
+    GpuRange indexTarget;
+    const void* vertexData;
+    const void* indexData;
+    GLenum indexType;
+    uint32_t indexCount;
+    uint64_t vertexCount;
+    std::shared_ptr<const void> storage;
+};
+
+// Fills mesh ranges on a loader thread that owns a second GL context sharing
+// objects with the main one. Data goes through a persistently mapped staging
+// ring and is copied into the GpuBufferArena ranges the main thread reserved;
+// a fence is attached to every finished mesh and handed back through a
+// lock-free queue. The main thread polls once per frame and only adopts
+// meshes whose fence has signaled, so it never blocks on an upload. Meshes
+// that fail their index check come back rejected and stay placeholders.
+class AsyncMeshLoader {
+private:
+    struct UploadedMesh {
+	uint64_t id;
+	Fence fence;
+	bool rejected;
+    };
+
+    static constexpr size_t stagingSegments = 4;
+    static constexpr size_t stagingSegmentSize = 4 << 20;
+
+    GLFWwindow* context;
+    std::thread thread;
+
+    std::mutex jobsMutex;
+    std::condition_variable jobsAvailable;
+    std::deque<MeshUploadJob> jobs;
+    std::atomic<bool> running;
+    std::atomic<size_t> inFlight;
+
+    SpscQueue<UploadedMesh> uploaded;
+    std::vector<UploadedMesh> pending;
+
+public:
+    AsyncMeshLoader()
+        : context{nullptr},
+          thread{},
+          jobsMutex{},
+          jobsAvailable{},
+          jobs{},
+          running{false},
+          inFlight{0},
+          uploaded{256},
+          pending{}
+    {}
+
+    AsyncMeshLoader(const AsyncMeshLoader&) = delete;
+    AsyncMeshLoader& operator=(const AsyncMeshLoader&) = delete;
+
+    ~AsyncMeshLoader() {
+	stop();
+    }
+
+    // Creates the hidden shared-context window and starts the thread. Must be
+    // called on the main thread, as GLFW requires for window creation.
+    bool start(GLFWwindow* shareWith) {
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	context = glfwCreateWindow(1, 1, "loader", NULL, shareWith);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+	if (context == nullptr) {
+	    std::cerr << "Failed to create loader context" << std::endl;
+	    return false;
+	}
+
+	running = true;
+	thread = std::thread(&AsyncMeshLoader::run, this);
+	return true;
+    }
+
+    void submit(MeshUploadJob job) {
+	{
+	    std::lock_guard<std::mutex> lock(jobsMutex);
+	    jobs.push_back(std::move(job));
+	    ++inFlight;
+	}
+	jobsAvailable.notify_one();
+    }
+
+    // True once every submitted mesh has been adopted
+    bool idle() const {
+	return inFlight.load() == 0;
+    }
+
+    // Reports every finished upload whose fence has signaled by calling
+    // onReady(id), which should create the mesh's VAO in the calling
+    // context. Rejected meshes are dropped without a call.
+    template <typename Callback>
+    size_t poll(Callback&& onReady) {
+	UploadedMesh mesh;
+	while (uploaded.pop(mesh)) {
+	    pending.push_back(std::move(mesh));
+	}
+
+	size_t ready = 0;
+	auto it = pending.begin();
+	while (it != pending.end()) {
+	    if (it->rejected) {
+		it = pending.erase(it);
+		--inFlight;
+		continue;
+	    }
+	    if (!it->fence.signaled()) {
+		++it;
+		continue;
+	    }
+
+	    onReady(it->id);
+
+	    it = pending.erase(it);
+	    --inFlight;
+	    ++ready;
+	}
+
+	return ready;
+    }
+
+    // Stops the thread and drops anything that was never adopted; the ranges
+    // themselves belong to their meshes
+    void stop() {
+	if (!running) {
+	    return;
+	}
+
+	// Cleared under the lock the thread checks it with, so the wakeup
+	// cannot slip in between its check and its wait
+	{
+	    std::lock_guard<std::mutex> lock(jobsMutex);
+	    running = false;
+	}
+	jobsAvailable.notify_one();
+	thread.join();
+
+	UploadedMesh mesh;
+	while (uploaded.pop(mesh)) {}
+	pending.clear();
+	jobs.clear();
+	inFlight = 0;
+
+	glfwDestroyWindow(context);
+	context = nullptr;
+    }
+
+private:
+    void run() {
+	// GLAD's function pointers were loaded on the main context; they are
+	// valid for any context of the same driver
+	glfwMakeContextCurrent(context);
+
+	GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	Buffer staging = Buffer::create();
+	glNamedBufferStorage(staging.get(), stagingSegments * stagingSegmentSize, nullptr, mapFlags);
+	auto* mapped = static_cast<uint8_t*>(
+	    glMapNamedBufferRange(staging.get(), 0, stagingSegments * stagingSegmentSize, mapFlags)
+	);
+
+	Fence segmentFences[stagingSegments];
+	size_t segment = 0;
+
+	// Streams bytes into a range one staging segment at a time, waiting
+	// only when the ring wraps onto a segment still being copied
+	auto copyToRange = [&](const GpuRange& target, const void* data) {
+	    size_t size = target.size;
+
+	    for (size_t offset = 0; offset < size; offset += stagingSegmentSize) {
+		size_t chunk = std::min(stagingSegmentSize, size - offset);
+
+		if (segmentFences[segment]) {
+		    segmentFences[segment].wait();
+		}
+
+		std::memcpy(mapped + segment * stagingSegmentSize, static_cast<const uint8_t*>(data) + offset, chunk);
+		glCopyNamedBufferSubData(staging.get(), target.buffer, segment * stagingSegmentSize, target.offset + offset, chunk);
+		segmentFences[segment] = Fence::insert();
+
+		segment = (segment + 1) % stagingSegments;
+	    }
+	};
+
+	while (true) {
+	    MeshUploadJob job;
+	    {
+		std::unique_lock<std::mutex> lock(jobsMutex);
+		jobsAvailable.wait(lock, [this] { return !jobs.empty() || !running; });
+
+		if (!running) {
+		    break;
+		}
+
+		job = std::move(jobs.front());
+		jobs.pop_front();
+	    }
+
+	    UploadedMesh mesh;
+	    mesh.id = job.id;
+	    mesh.rejected = !indicesInRange(job.indexData, job.indexType, job.indexCount, job.vertexCount);
+
+	    if (mesh.rejected) {
+		std::cerr << "ERROR::LOADER::INDEX_OUT_OF_RANGE mesh " << job.id << std::endl;
+	    } else {
+		copyToRange(job.vertexTarget, job.vertexData);
+		copyToRange(job.indexTarget, job.indexData);
+		mesh.fence = Fence::insert();
+
+		// The fence must reach the GPU before another context can wait on it
+		glFlush();
+	    }
+
+	    // push() only moves from mesh on success; anything left unqueued at
+	    // shutdown is dropped along with its fence
+	    while (!uploaded.push(std::move(mesh)) && running) {
+		std::this_thread::yield();
+	    }
+	}
+
+	for (auto& fence : segmentFences) {
+	    fence.reset();
+	}
+	glUnmapNamedBuffer(staging.get());
+	staging.reset();
+	glFinish();
+
+	glfwMakeContextCurrent(NULL);
+    }
+};
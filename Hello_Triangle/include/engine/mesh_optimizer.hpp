@@ -0,0 +1,297 @@
+#pragma once
+
+#include <engine/mesh.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <ostream>
+#include <vector>
+
+// Post-transform vertex cache statistics from a FIFO cache simulation.
+// ACMR: cache misses per triangle (0.5 is ideal for large regular meshes).
+// ATVR: cache misses per vertex (1.0 is ideal, every vertex shaded once).
+struct VertexCacheStats {
+    size_t misses;
+    float acmr;
+    float atvr;
+};
+
+inline VertexCacheStats analyzeVertexCache(
+    const std::vector<uint32_t>& indices,
+    size_t vertexCount,
+    unsigned cacheSize = 16)
+{
+    // A vertex is still cached while fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    size_t misses = 0;
+    size_t time = cacheSize + 1;
+
+    for (uint32_t index : indices) {
+	if (time - loadedAt[index] > cacheSize) {
+	    loadedAt[index] = time++;
+	    ++misses;
+	}
+    }
+
+    size_t triangles = indices.size() / 3;
+    return {
+	misses,
+	triangles ? (float)misses / (float)triangles : 0.0f,
+	vertexCount ? (float)misses / (float)vertexCount : 0.0f
+    };
+}
+
+struct MeshOptimizerOptions {
+    unsigned cacheSize = 16;
+
+    // Reorders Tipsify's clusters so outward facing ones draw first, as long
+    // as ACMR doesn't grow by more than overdrawThreshold
+    bool optimizeOverdraw = false;
+    float overdrawThreshold = 1.05f;
+};
+
+struct MeshOptimizationReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t clusters;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const MeshOptimizationReport& report) {
+    return os << "ACMR " << report.before.acmr << " -> " << report.after.acmr
+	      << ", ATVR " << report.before.atvr << " -> " << report.after.atvr
+	      << " (" << report.clusters << " clusters)";
+}
+
+// Tipsify (Sander, Nehab & Barczak, "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw", 2007). Reorders triangles for a vertex
+// cache of cacheSize entries in linear time. If clusterStarts is given it
+// receives the first triangle of each cluster, split where the fan hits a
+// dead end.
+inline std::vector<uint32_t> tipsify(
+    const std::vector<uint32_t>& indices,
+    size_t vertexCount,
+    unsigned cacheSize,
+    std::vector<size_t>* clusterStarts = nullptr)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    // Vertex -> triangle adjacency in CSR form
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+	offsets[index + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+	adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+	liveTriangles[v] = offsets[v + 1] - offsets[v];
+    }
+
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = vertexCount ? 0 : -1;
+
+    while (fanning >= 0) {
+	candidates.clear();
+
+	for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; ++k) {
+	    uint32_t triangle = adjacency[k];
+	    if (emitted[triangle]) {
+		continue;
+	    }
+
+	    for (int corner = 0; corner < 3; ++corner) {
+		uint32_t v = indices[triangle * 3 + corner];
+
+		output.push_back(v);
+		deadEnd.push_back(v);
+		candidates.push_back(v);
+		liveTriangles[v]--;
+
+		if (time - cacheTime[v] > cacheSize) {
+		    cacheTime[v] = time++;
+		}
+	    }
+
+	    emitted[triangle] = true;
+	}
+
+	// Prefer the candidate that will still be cached after its remaining triangles
+	int64_t next = -1;
+	int64_t best = -1;
+	for (uint32_t v : candidates) {
+	    if (liveTriangles[v] == 0) {
+		continue;
+	    }
+
+	    int64_t priority = 0;
+	    if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+		priority = time - cacheTime[v];
+	    }
+	    if (priority > best) {
+		best = priority;
+		next = v;
+	    }
+	}
+
+	if (next == -1) {
+	    // Dead end: fall back to recently used vertices, then scan for any with live triangles
+	    while (!deadEnd.empty()) {
+		uint32_t v = deadEnd.back();
+		deadEnd.pop_back();
+		if (liveTriangles[v] > 0) {
+		    next = v;
+		    break;
+		}
+	    }
+
+	    while (next == -1 && cursor < vertexCount) {
+		if (liveTriangles[cursor] > 0) {
+		    next = cursor;
+		}
+		++cursor;
+	    }
+
+	    // A dead end before anything was emitted (vertex 0 has no
+	    // triangles) starts the first cluster, which is added below
+	    if (clusterStarts && next != -1 && !output.empty()) {
+		clusterStarts->push_back(output.size() / 3);
+	    }
+	}
+
+	fanning = next;
+    }
+
+    if (clusterStarts) {
+	clusterStarts->insert(clusterStarts->begin(), 0);
+    }
+
+    return output;
+}
+
+// Sorts clusters so those facing away from the mesh centroid are drawn first;
+// they're the most likely to occlude the rest. Returns the reordered indices.
+inline std::vector<uint32_t> sortClustersForOverdraw(
+    const std::vector<uint32_t>& indices,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<size_t>& clusterStarts)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    glm::vec3 meshCentroid(0.0f);
+    for (const auto& p : positions) {
+	meshCentroid += p;
+    }
+    if (!positions.empty()) {
+	meshCentroid = meshCentroid / (float)positions.size();
+    }
+
+    std::vector<float> sortKey(clusterStarts.size());
+    for (size_t c = 0; c < clusterStarts.size(); ++c) {
+	size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+	glm::vec3 centroid(0.0f);
+	glm::vec3 normal(0.0f);
+	float area = 0.0f;
+
+	for (size_t t = clusterStarts[c]; t < end; ++t) {
+	    const glm::vec3& a = positions[indices[t * 3 + 0]];
+	    const glm::vec3& b = positions[indices[t * 3 + 1]];
+	    const glm::vec3& d = positions[indices[t * 3 + 2]];
+
+	    // Area weighted, the cross product's length is twice the triangle's area
+	    glm::vec3 n = glm::cross(b - a, d - a);
+	    float weight = glm::length(n);
+
+	    normal += n;
+	    centroid += (a + b + d) * (weight / 3.0f);
+	    area += weight;
+	}
+
+	if (area > 0.0f) {
+	    centroid = centroid / area;
+	}
+
+	sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+    }
+
+    std::vector<size_t> order(clusterStarts.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+	[&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; }
+    );
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (size_t c : order) {
+	size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+	output.insert(output.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + end * 3);
+    }
+
+    return output;
+}
+
+// Renumbers vertices in the order the index buffer first references them so
+// vertex fetch walks memory linearly. Unreferenced vertices are dropped.
+inline void optimizeVertexFetch(MeshData& data) {
+    constexpr uint32_t unassigned = ~0u;
+    std::vector<uint32_t> remap(data.positions.size(), unassigned);
+    MeshData reordered;
+
+    for (uint32_t& index : data.indices) {
+	if (remap[index] == unassigned) {
+	    remap[index] = reordered.positions.size();
+	    reordered.positions.push_back(data.positions[index]);
+	    reordered.colors.push_back(data.colors[index]);
+	}
+	index = remap[index];
+    }
+
+    data.positions = std::move(reordered.positions);
+    data.colors = std::move(reordered.colors);
+}
+
+// Reorders triangles for the post-transform cache, optionally sorts clusters
+// for overdraw, then reorders vertices for fetch locality
+inline MeshOptimizationReport optimizeMesh(MeshData& data, const MeshOptimizerOptions& options = {}) {
+    MeshOptimizationReport report{};
+    size_t vertexCount = data.positions.size();
+
+    report.before = analyzeVertexCache(data.indices, vertexCount, options.cacheSize);
+
+    std::vector<size_t> clusterStarts;
+    std::vector<uint32_t> indices = tipsify(data.indices, vertexCount, options.cacheSize, &clusterStarts);
+    report.clusters = clusterStarts.size();
+
+    if (options.optimizeOverdraw && clusterStarts.size() > 1) {
+	float acmr = analyzeVertexCache(indices, vertexCount, options.cacheSize).acmr;
+	std::vector<uint32_t> sorted = sortClustersForOverdraw(indices, data.positions, clusterStarts);
+
+	if (analyzeVertexCache(sorted, vertexCount, options.cacheSize).acmr <= acmr * options.overdrawThreshold) {
+	    indices = std::move(sorted);
+	}
+    }
+
+    data.indices = std::move(indices);
+    optimizeVertexFetch(data);
+
+    report.after = analyzeVertexCache(data.indices, data.positions.size(), options.cacheSize);
+
+    return report;
+}
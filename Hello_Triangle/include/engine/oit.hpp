@@ -0,0 +1,139 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <engine/shader.hpp>
+
+// Weighted blended order-independent transparency (McGuire & Bavoil 2013).
+//
+// Translucent geometry is drawn in any order into two targets: an RGBA16F
+// accumulation buffer (premultiplied color and alpha, scaled by a depth
+// weight) and an R8 revealage buffer (product of 1 - alpha). A single
+// full-screen composite then resolves them over the opaque image.
+//
+// Translucent fragment shaders must write:
+//   layout (location = 0) out vec4 accum;   // vec4(color * a, a) * weight
+//   layout (location = 1) out float reveal; // a
+class WeightedBlendedOIT {
+private:
+    Framebuffer FBO;
+    Texture accumTexture, revealTexture;
+    VertexArray emptyVAO;
+    Program compositeProgram;
+    int width, height;
+
+    static constexpr const char* compositeVertexSource = R"(
+#version 460 core
+void main()
+{
+    // Full-screen triangle from the vertex index
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(pos * 2.0f - 1.0f, 0.0f, 1.0f);
+})";
+
+    static constexpr const char* compositeFragmentSource = R"(
+#version 460 core
+layout (binding = 0) uniform sampler2D accumTexture;
+layout (binding = 1) uniform sampler2D revealTexture;
+out vec4 FragColor;
+void main()
+{
+    ivec2 coords = ivec2(gl_FragCoord.xy);
+
+    float revealage = texelFetch(revealTexture, coords, 0).r;
+    if (revealage == 1.0f)
+        discard;
+
+    vec4 accumulation = texelFetch(accumTexture, coords, 0);
+
+    // Guard against overflow of the half-float weights
+    if (isinf(max(abs(accumulation.r), max(abs(accumulation.g), abs(accumulation.b)))))
+        accumulation.rgb = vec3(accumulation.a);
+
+    vec3 averageColor = accumulation.rgb / max(accumulation.a, 1e-5f);
+    FragColor = vec4(averageColor, 1.0f - revealage);
+})";
+
+public:
+    WeightedBlendedOIT()
+        : FBO{Framebuffer::create()},
+          accumTexture{Texture::create()},
+          revealTexture{Texture::create()},
+          emptyVAO{VertexArray::create()},
+          compositeProgram{createProgram(compositeVertexSource, compositeFragmentSource)},
+          width{0},
+          height{0}
+    {}
+
+    bool isValid() const {
+	return static_cast<bool>(compositeProgram);
+    }
+
+    // Reallocates the targets if the size changed and attaches the opaque
+    // pass's depth texture so translucent fragments are occluded by it
+    void resize(int newWidth, int newHeight, GLuint depthTexture) {
+	if (newWidth == width && newHeight == height) {
+	    return;
+	}
+
+	width = newWidth;
+	height = newHeight;
+
+	glBindTexture(GL_TEXTURE_2D, accumTexture.get());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, revealTexture.get());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO.get());
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture.get(), 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealTexture.get(), 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Binds and clears the OIT targets and sets the accumulation blend state.
+    // Depth is tested against the opaque pass but not written.
+    void begin() const {
+	const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat one[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO.get());
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, one);
+
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunci(0, GL_ONE, GL_ONE);
+	glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+    }
+
+    // Resolves the accumulated translucency over the currently bound
+    // framebuffer with a single full-screen draw
+    void composite() const {
+	glDisable(GL_DEPTH_TEST);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glUseProgram(compositeProgram.get());
+	glBindTextureUnit(0, accumTexture.get());
+	glBindTextureUnit(1, revealTexture.get());
+
+	glBindVertexArray(emptyVAO.get());
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <engine/mesh.hpp>
+#include <engine/mesh_optimizer.hpp>
+
+#include <array>
+
+// The pyramid mesh the scenes are built from: its geometry and how it is
+// packed for the GPU. Per-object state lives in the scene's components.
+class Pyramid {
+private:
+    static constexpr const std::array<glm::vec3, 12> vertices = {{
+        {0.0f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f},         // top-center           0
+        {0.5f, -0.5f, 0.5f}, {1.0f, 0.0f, 0.0f},        // back-right           1
+        {-0.5f, -0.5f, 0.5f}, {0.0f, 1.0f, 0.0f},       // back-left            2
+        {0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, 1.0f},       // front-right          3
+        {-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 1.0f},      // front-left           4
+        {0.0f, -0.5f, 0.0f}, {0.0f, 0.0f, 0.0f}        	// bottom-center        5
+    }};
+
+    static constexpr const std::array<unsigned int, 24> indices = {{
+        0,1,2, // face 1
+        0,3,4, // face 2
+        0,1,3, // face 3
+        0,2,4, // face 4
+
+	// Bottom
+        5,1,2,
+        5,1,3,
+        5,3,4,
+        5,2,4
+    }};
+
+public:
+
+    // Radius of a sphere around the origin enclosing every vertex
+    static constexpr float boundingRadius = 0.8660254f;
+
+    // Half-float positions and RGBA8 colors are exact for this geometry and
+    // take 12 bytes per vertex instead of 24
+    static constexpr VertexFormat vertexFormat = {
+        PositionFormat::HalfFloat,
+        ColorFormat::Unorm8
+    };
+
+    // Splits the interleaved position/color table into a MeshData and runs
+    // it through the mesh optimizer once, like any imported mesh
+    static const MeshData& meshData() {
+	return optimized().data;
+    }
+
+    // What the optimizer achieved, for callers that want to log it
+    static const MeshOptimizationReport& optimizationReport() {
+	return optimized().report;
+    }
+
+private:
+    struct OptimizedMesh {
+	MeshData data;
+	MeshOptimizationReport report;
+    };
+
+    static const OptimizedMesh& optimized() {
+	static const OptimizedMesh mesh = [] {
+	    OptimizedMesh mesh;
+
+	    for (size_t i = 0; i < vertices.size(); i += 2) {
+		mesh.data.positions.push_back(vertices[i]);
+		mesh.data.colors.push_back(vertices[i + 1]);
+	    }
+	    mesh.data.indices.assign(indices.begin(), indices.end());
+
+	    mesh.report = optimizeMesh(mesh.data);
+	    return mesh;
+	}();
+
+	return mesh;
+    }
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <engine/gl_handle.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// One frame's pixels, straight from the mapped buffer they were read into.
+// The memory is reused for a later frame once the consumer returns.
+struct ReadbackFrame {
+    uint64_t frame;
+    int width;
+    int height;
+    size_t rowSize;         // bytes per row, tightly packed
+    const uint8_t* data;    // rows bottom to top, as GL returns them
+
+    // Row y counted from the top of the image
+    const uint8_t* row(int y) const {
+	return data + (size_t)(height - 1 - y) * rowSize;
+    }
+};
+
+// Copies each frame's color texture into the next of a ring of
+// persistently mapped pixel pack buffers and hands it to the consumer once
+// its fence signals, usually depth - 1 frames later. The copy runs on the
+// GPU alongside the following frames instead of stalling the GL thread the
+// way a synchronous glReadPixels would, and the consumer reads the mapped
+// buffer directly without another copy.
+//
+// Everything, the consumer included, runs on the GL thread.
+class FrameReadback {
+public:
+    using Consumer = std::function<void(const ReadbackFrame&)>;
+
+private:
+    static constexpr GLbitfield mapFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    struct Slot {
+	Buffer buffer;
+	const uint8_t* mapped = nullptr;
+	size_t capacity = 0;
+	Fence fence;
+	ReadbackFrame frame{};
+    };
+
+    std::vector<Slot> slots;
+    GLenum format;
+    size_t pixelSize;
+    Consumer consumer;
+    size_t oldest;      // first slot in flight
+    size_t pending;     // slots in flight
+
+    // Replaces the slot's storage if it is too small for bytes
+    void reserve(Slot& slot, size_t bytes) {
+	if (slot.capacity >= bytes) {
+	    return;
+	}
+
+	if (slot.buffer) {
+	    glUnmapNamedBuffer(slot.buffer.get());
+	}
+
+	slot.buffer = Buffer::create();
+	glNamedBufferStorage(slot.buffer.get(), bytes, nullptr, mapFlags);
+	slot.mapped = static_cast<const uint8_t*>(glMapNamedBufferRange(slot.buffer.get(), 0, bytes, mapFlags));
+	slot.capacity = bytes;
+    }
+
+    // Hands the oldest slot in flight to the consumer, waiting for it if asked
+    bool consumeOldest(bool wait) {
+	Slot& slot = slots[oldest];
+	if (!wait && !slot.fence.signaled()) {
+	    return false;
+	}
+
+	slot.fence.wait();
+	slot.fence.reset();
+
+	slot.frame.data = slot.mapped;
+	consumer(slot.frame);
+
+	oldest = (oldest + 1) % slots.size();
+	--pending;
+	return true;
+    }
+
+public:
+    // format is GL_RGBA, GL_RGB or GL_RED, read as unsigned bytes
+    FrameReadback(size_t depth, GLenum format, Consumer consumer)
+        : slots(depth > 0 ? depth : 1),
+          format{format},
+          pixelSize{format == GL_RED ? 1u : format == GL_RGB ? 3u : 4u},
+          consumer{std::move(consumer)},
+          oldest{0},
+          pending{0}
+    {}
+
+    FrameReadback(const FrameReadback&) = delete;
+    FrameReadback& operator=(const FrameReadback&) = delete;
+
+    // Waits for the frames still in flight, so none is lost
+    ~FrameReadback() {
+	flush();
+
+	for (auto& slot : slots) {
+	    if (slot.buffer) {
+		glUnmapNamedBuffer(slot.buffer.get());
+	    }
+	}
+    }
+
+    // Queues a copy of level 0 of texture. Only blocks when every slot is
+    // still in flight, in which case the oldest is consumed first.
+    void capture(GLuint texture, int width, int height, uint64_t frame) {
+	poll();
+	if (pending == slots.size()) {
+	    consumeOldest(true);
+	}
+
+	Slot& slot = slots[(oldest + pending) % slots.size()];
+	size_t rowSize = (size_t)width * pixelSize;
+	reserve(slot, rowSize * height);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer.get());
+	glGetTextureImage(texture, 0, format, GL_UNSIGNED_BYTE, (GLsizei)(rowSize * height), nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = Fence::insert();
+	slot.frame = { frame, width, height, rowSize, nullptr };
+	++pending;
+    }
+
+    // Consumes every frame that has arrived, oldest first, without waiting.
+    // Returns how many there were.
+    size_t poll() {
+	size_t consumed = 0;
+	while (pending > 0 && consumeOldest(false)) {
+	    ++consumed;
+	}
+	return consumed;
+    }
+
+    // Waits for and consumes every frame in flight
+    void flush() {
+	while (pending > 0) {
+	    consumeOldest(true);
+	}
+    }
+
+    size_t inFlight() const {
+	return pending;
+    }
+};
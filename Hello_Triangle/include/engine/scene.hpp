@@ -0,0 +1,350 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <engine/camera.hpp>
+#include <engine/command_buffer.hpp>
+#include <engine/frame_pipeline.hpp>
+#include <engine/material.hpp>
+#include <engine/mesh.hpp>
+#include <engine/pyramid.hpp>
+#include <engine/scene_generator.hpp>
+#include <engine/scene_store.hpp>
+#include <engine/transform_hierarchy.hpp>
+#include <engine/uniform_buffer.hpp>
+#include <engine/worker_pool.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Components of a scene object. Each is stored in its own dense array (see
+// Archetype), so the simulation streams through poses and spins only, and
+// the GL thread reads meshes, materials and bounds, which never change
+// after the scene is built and so never race with the simulation.
+
+// Pose relative to the parent object, or to the world for a root: a
+// placement followed by the rotations about X, Y and Z and a scale
+struct Transform {
+    glm::mat4 placement{1.0f};
+    glm::mat4 rotationX{1.0f};
+    glm::mat4 rotationY{1.0f};
+    glm::mat4 rotationZ{1.0f};
+    glm::mat4 scaling{1.0f};
+};
+
+// Degrees per second about the X and Y axes
+struct Motion {
+    glm::vec2 spin{180.0f, 720.0f};
+};
+
+inline bool isStatic(const Motion& motion) {
+    return motion.spin.x == 0.0f && motion.spin.y == 0.0f;
+}
+
+// What to draw and how. Meshes and materials are shared between objects.
+struct Renderable {
+    const Mesh* mesh;
+    const Material* material;
+};
+
+// Radius of a sphere around the mesh origin enclosing every vertex
+struct Bounds {
+    float radius;
+};
+
+inline void translate(Transform& transform, const glm::vec3& translation) {
+    transform.placement = glm::translate(transform.placement, translation);
+}
+
+inline void scale(Transform& transform, const glm::vec3& factors) {
+    transform.scaling = glm::scale(glm::mat4(1.0f), factors);
+}
+
+inline void rotateX(Transform& transform, float angleDegrees) {
+    transform.rotationX = glm::rotate(transform.rotationX, glm::radians(angleDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
+}
+
+inline void rotateY(Transform& transform, float angleDegrees) {
+    transform.rotationY = glm::rotate(transform.rotationY, glm::radians(angleDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+inline void rotateZ(Transform& transform, float angleDegrees) {
+    transform.rotationZ = glm::rotate(transform.rotationZ, glm::radians(angleDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+inline glm::mat4 modelMatrix(const Transform& transform) {
+    return transform.placement
+	    * transform.rotationX
+	    * transform.rotationY
+	    * transform.rotationZ
+	    * transform.scaling;
+}
+
+// The model matrix after spinning for time seconds from the current pose,
+// without changing it. Unlike repeated rotateX/rotateY steps the result
+// does not depend on how the time was divided into frames.
+inline glm::mat4 modelMatrixAt(const Transform& transform, const Motion& motion, float time) {
+    glm::mat4 spunX = glm::rotate(transform.rotationX, glm::radians(motion.spin.x * time), glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::mat4 spunY = glm::rotate(transform.rotationY, glm::radians(motion.spin.y * time), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    return transform.placement
+	    * spunX
+	    * spunY
+	    * transform.rotationZ
+	    * transform.scaling;
+}
+
+// The objects plus the hierarchy placing them. Node n of the hierarchy
+// belongs to the entity with index n; its local matrix is the entity's
+// Transform and its world matrix the model matrix the object is drawn with.
+//
+// The store is inherited privately: creating and destroying rows has to go
+// through Scene so the hierarchy and the placed flags stay in step.
+class Scene : private Archetype<Transform, Motion, Renderable, Bounds> {
+public:
+    using Archetype::alive;
+    using Archetype::row;
+    using Archetype::entity;
+    using Archetype::size;
+    using Archetype::column;
+    using Archetype::get;
+
+    TransformHierarchy hierarchy;
+
+    // Per row, set when the row got its entity since the last
+    // simulateFrame(), by a create or by a destroy moving the last row
+    // into it, so whatever was written for the row before is stale
+    std::vector<uint8_t> placed;
+
+    void reserve(size_t count) {
+	Archetype::reserve(count);
+	placed.reserve(count);
+    }
+
+    // Adds a root object
+    Entity create(Transform transform, Motion motion, Renderable renderable, Bounds bounds) {
+	glm::mat4 local = modelMatrix(transform);
+	Entity entity = Archetype::create(std::move(transform), std::move(motion), std::move(renderable), std::move(bounds));
+	hierarchy.add(entity.index, local);
+	placed.resize(size(), 0);
+	placed[row(entity)] = 1;
+	return entity;
+    }
+
+    // Children of a destroyed object become roots
+    void destroy(Entity entity) {
+	if (!alive(entity)) {
+	    return;
+	}
+
+	uint32_t emptied = row(entity);
+	hierarchy.remove(entity.index);
+	Archetype::destroy(entity);
+
+	placed.resize(size());
+	if (emptied < size()) {
+	    placed[emptied] = 1;
+	}
+    }
+
+    // Makes child's Transform relative to parent from now on
+    bool setParent(Entity child, Entity parent) {
+	return alive(child) && alive(parent) && hierarchy.setParent(child.index, parent.index);
+    }
+
+    bool detach(Entity child) {
+	return alive(child) && hierarchy.setParent(child.index, TransformHierarchy::none);
+    }
+
+    // Call after changing the Transform of a row, so the object and its
+    // subtree are recomputed by the next hierarchy update
+    void transformChanged(size_t row) {
+	hierarchy.setLocal(entity(row).index, modelMatrix(column<Transform>()[row]));
+    }
+};
+
+// Adds an object at the given pose with the default spin
+inline Entity createObject(Scene& scene, const Transform& transform, const Mesh* mesh, const Material* material, float radius) {
+    return scene.create(transform, Motion{}, Renderable{ mesh, material }, Bounds{ radius });
+}
+
+// Model matrices of every object, row by row, after spinning for time
+// seconds from the current poses; see modelMatrixAt()
+inline void modelMatricesAt(Scene& scene, float time, std::vector<glm::mat4>& models) {
+    const std::vector<Transform>& transforms = scene.column<Transform>();
+    const std::vector<Motion>& motions = scene.column<Motion>();
+
+    std::vector<glm::mat4> locals(scene.hierarchy.idLimit());
+    for (size_t i = 0; i < scene.size(); ++i) {
+	locals[scene.entity(i).index] = modelMatrixAt(transforms[i], motions[i], time);
+    }
+
+    std::vector<glm::mat4> worlds;
+    scene.hierarchy.compose(locals, worlds);
+
+    models.resize(scene.size());
+    for (size_t i = 0; i < scene.size(); ++i) {
+	models[i] = worlds[scene.entity(i).index];
+    }
+}
+
+// Records the draw of a scene row, from any thread. The vertex shader reads
+// the model matrix from the transform buffer at the row, through
+// gl_BaseInstance, so nothing is written per draw.
+inline void recordObject(CommandBuffer& commands, const Renderable& renderable, uint32_t row) {
+    renderable.mesh->recordInstance(commands, row);
+}
+
+// Writes the model matrix into the object's slot of the uniform stream and
+// draws, on the GL thread
+inline void drawObject(const Renderable& renderable, const UniformStream& uniforms, GLintptr slot, const glm::mat4& model) {
+    static_cast<ObjectConstants*>(uniforms.pointer(slot))->model = model;
+    glBindBufferRange(GL_UNIFORM_BUFFER, objectBlockBinding, uniforms.get(), slot, sizeof(ObjectConstants));
+    renderable.mesh->draw();
+}
+
+// Conservative test of an object's bounding sphere against the view frustum
+inline bool isVisible(const Frustum& frustum, const glm::mat4& transform, const Bounds& bounds) {
+    glm::vec3 center(transform[3]);
+    float scale = std::max({
+	glm::length(glm::vec3(transform[0])),
+	glm::length(glm::vec3(transform[1])),
+	glm::length(glm::vec3(transform[2]))
+    });
+
+    return frustum.intersectsSphere(center, bounds.radius * scale);
+}
+
+// Motion system: advances every spinning object by delta_time, propagates
+// the new poses down the hierarchy (a level at a time across workers, if
+// given) and brings the model matrices the GL thread will draw from up to
+// date, row for row. Objects without spin are never marked, so unless an
+// ancestor moves their matrices are neither recomputed nor copied.
+//
+// packet.transforms must hold what the previous call left in it. The rows
+// that changed are listed in packet.moved with their old matrices in
+// previousTransforms. That includes the rows placed since (Scene::placed):
+// what they held belonged to another object or none, so they list their
+// new matrix instead and are not blended.
+// It touches only the Transform and Motion arrays, the hierarchy and the
+// placed flags.
+// Culling is left to the GL side, which knows the camera.
+inline void simulateFrame(Scene& scene, float delta_time, FramePacket& packet, WorkerPool* workers = nullptr) {
+    std::vector<Transform>& transforms = scene.column<Transform>();
+    const std::vector<Motion>& motions = scene.column<Motion>();
+
+    for (size_t i = 0; i < scene.size(); ++i) {
+	if (isStatic(motions[i])) {
+	    continue;
+	}
+
+	rotateY(transforms[i], motions[i].spin.y * delta_time);
+	rotateX(transforms[i], motions[i].spin.x * delta_time);
+	scene.transformChanged(i);
+    }
+
+    scene.hierarchy.update(workers);
+
+    packet.transforms.resize(scene.size());
+    packet.moved.clear();
+    packet.previousTransforms.clear();
+
+    for (size_t i = 0; i < scene.size(); ++i) {
+	uint32_t node = scene.entity(i).index;
+
+	if (scene.placed[i]) {
+	    scene.placed[i] = 0;
+	    packet.moved.push_back((uint32_t)i);
+	    packet.previousTransforms.push_back(scene.hierarchy.world(node));
+	    packet.transforms[i] = scene.hierarchy.world(node);
+	} else if (scene.hierarchy.changed(node)) {
+	    packet.moved.push_back((uint32_t)i);
+	    packet.previousTransforms.push_back(packet.transforms[i]);
+	    packet.transforms[i] = scene.hierarchy.world(node);
+	}
+    }
+}
+
+// Lays out the default triangular grid of opaque pyramids in the 2x2
+// square around the origin
+inline void buildGridScene(
+    Scene& scene,
+    const Mesh* mesh,
+    const Material* opaqueMaterial)
+{
+    int num_rows = 10;
+    int num_cols = num_rows;
+    float vertical_offset = (2.0f / (float)num_rows);
+    float horizontal_offset = (2.0f / (float)num_rows);
+
+    scene.reserve(scene.size() + num_rows * (num_rows + 1) / 2);
+
+    for (int i = 0; i < num_rows; ++i) {
+	for (int j = 0; j < num_cols; ++j) {
+
+	    Transform transform;
+
+	    translate(
+		transform,
+		glm::vec3(
+		    (-2.0f + horizontal_offset * (1 + i + (j<<1)) ) / 2.0f,
+		    (-2.0f + vertical_offset   * (1 + 0 + (i<<1)) ) / 2.0f,
+		    0.0f
+		)
+	    );
+
+	    scale(
+		transform,
+		glm::vec3(
+		    1.0f / (float)(num_rows + num_rows),
+		    1.0f / (float)(num_rows + num_rows),
+		    1.0f / (float)(num_rows + num_rows)
+		)
+	    );
+
+	    if ((j + i) % 2 == 0) {
+		rotateX(transform, 180.0f);
+	    }
+
+	    createObject(scene, transform, mesh, opaqueMaterial, Pyramid::boundingRadius);
+	}
+
+	num_cols--;
+    }
+}
+
+// Places the pyramids of a procedural layout. Each keeps the spin the
+// generator gave it and is attached to its generated parent, if any.
+inline void buildGeneratedScene(
+    Scene& scene,
+    const SceneGeneratorOptions& options,
+    const Mesh* mesh,
+    const Material* opaqueMaterial,
+    const Material* translucentMaterial)
+{
+    scene.reserve(scene.size() + options.count);
+
+    // Objects are appended in generation order, so a parent's row follows
+    // from its index
+    size_t firstRow = scene.size();
+
+    generateScene(options, [&](const GeneratedObject& object) {
+	Transform transform;
+	transform.placement = object.placement;
+
+	Entity entity = scene.create(
+	    transform,
+	    Motion{ object.spin },
+	    Renderable{ mesh, object.translucent ? translucentMaterial : opaqueMaterial },
+	    Bounds{ Pyramid::boundingRadius }
+	);
+
+	if (object.parent != GeneratedObject::noParent) {
+	    scene.setParent(entity, scene.entity(firstRow + object.parent));
+	}
+    });
+}
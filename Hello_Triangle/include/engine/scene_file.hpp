@@ -0,0 +1,291 @@
+#pragma once
+
+#include <engine/mesh.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary scene container. Everything is little-endian and laid out so the
+// file can be mapped and handed to GL as is:
+//
+//   SceneFileHeader
+//   SceneFileMesh[meshCount]
+//   SceneFileInstance[instanceCount]
+//   per mesh: packed vertex blob, packed index blob (each page aligned)
+//
+// Vertex blobs use the interleaved layout produced by packVertices() and
+// index blobs the index type recorded for the mesh.
+constexpr char sceneFileMagic[8] = { 'P', 'Y', 'R', 'S', 'C', 'E', 'N', 'E' };
+constexpr uint32_t sceneFileVersion = 2;
+constexpr uint64_t sceneFileAlignment = 4096;
+
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t meshCount;
+    uint64_t meshTableOffset;
+    uint64_t instanceCount;
+    uint64_t instanceTableOffset;
+    uint64_t fileSize;
+};
+
+struct SceneFileMesh {
+    uint64_t vertexOffset;
+    uint64_t vertexSize;
+    uint64_t indexOffset;
+    uint32_t indexCount;
+    uint32_t indexType;
+    uint8_t positionFormat;
+    uint8_t colorFormat;
+    uint8_t padding[6];
+
+    VertexFormat vertexFormat() const {
+	VertexFormat format;
+	format.position = static_cast<PositionFormat>(positionFormat);
+	format.color = static_cast<ColorFormat>(colorFormat);
+	return format;
+    }
+};
+
+struct SceneFileInstance {
+    float transform[16];  // column-major model matrix
+    uint32_t mesh;        // index into the mesh table
+    uint32_t material;    // index into the application's material table
+    float spin[2];        // degrees per second about X and Y (version 2)
+};
+
+static_assert(sizeof(SceneFileHeader) == 48, "SceneFileHeader layout changed");
+static_assert(sizeof(SceneFileMesh) == 40, "SceneFileMesh layout changed");
+static_assert(sizeof(SceneFileInstance) == 80, "SceneFileInstance layout changed");
+
+inline uint64_t alignSceneOffset(uint64_t offset) {
+    return (offset + sceneFileAlignment - 1) & ~(sceneFileAlignment - 1);
+}
+
+// Packs meshes and instances into a scene file. Returns false on I/O errors.
+inline bool writeSceneFile(
+    const std::string& path,
+    const std::vector<MeshData>& meshes,
+    const std::vector<VertexFormat>& formats,
+    const std::vector<SceneFileInstance>& instances)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+	std::cerr << "ERROR::SCENE::OPEN_FAILED " << path << std::endl;
+	return false;
+    }
+
+    SceneFileHeader header{};
+    std::memcpy(header.magic, sceneFileMagic, sizeof(header.magic));
+    header.version = sceneFileVersion;
+    header.meshCount = meshes.size();
+    header.meshTableOffset = sizeof(SceneFileHeader);
+    header.instanceCount = instances.size();
+    header.instanceTableOffset = header.meshTableOffset + meshes.size() * sizeof(SceneFileMesh);
+
+    std::vector<SceneFileMesh> table(meshes.size());
+    std::vector<std::vector<uint8_t>> vertexBlobs, indexBlobs;
+    uint64_t offset = header.instanceTableOffset + instances.size() * sizeof(SceneFileInstance);
+
+    for (size_t i = 0; i < meshes.size(); ++i) {
+	GLenum indexType = chooseIndexType(meshes[i].positions.size(), formats[i].allowByteIndices);
+
+	vertexBlobs.push_back(packVertices(meshes[i], formats[i]));
+	indexBlobs.push_back(packIndices(meshes[i].indices, indexType));
+
+	table[i] = {};
+	table[i].vertexOffset = alignSceneOffset(offset);
+	table[i].vertexSize = vertexBlobs[i].size();
+	table[i].indexOffset = alignSceneOffset(table[i].vertexOffset + table[i].vertexSize);
+	table[i].indexCount = meshes[i].indices.size();
+	table[i].indexType = indexType;
+	table[i].positionFormat = static_cast<uint8_t>(formats[i].position);
+	table[i].colorFormat = static_cast<uint8_t>(formats[i].color);
+
+	offset = table[i].indexOffset + indexBlobs[i].size();
+    }
+
+    header.fileSize = offset;
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SceneFileMesh));
+    file.write(reinterpret_cast<const char*>(instances.data()), instances.size() * sizeof(SceneFileInstance));
+
+    auto writeAt = [&file](uint64_t at, const std::vector<uint8_t>& blob) {
+	static const char zeros[sceneFileAlignment] = {};
+	uint64_t position = file.tellp();
+	file.write(zeros, at - position);
+	file.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+    };
+
+    for (size_t i = 0; i < meshes.size(); ++i) {
+	writeAt(table[i].vertexOffset, vertexBlobs[i]);
+	writeAt(table[i].indexOffset, indexBlobs[i]);
+    }
+
+    if (!file) {
+	std::cerr << "ERROR::SCENE::WRITE_FAILED " << path << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+// Read-only mapping of a scene file. Tables and blobs are used in place;
+// nothing is parsed or copied. Opening checks the header and tables: bounds
+// and alignment of the tables and blobs and the format enums. Whether every
+// index addresses a vertex of its mesh means reading all of them, so that
+// is left to the loader thread, mesh by mesh (see MeshUploadJob).
+class MappedSceneFile {
+private:
+    const uint8_t* data;
+    size_t size;
+
+public:
+    MappedSceneFile()
+        : data{nullptr},
+          size{0}
+    {}
+
+    MappedSceneFile(const MappedSceneFile&) = delete;
+    MappedSceneFile& operator=(const MappedSceneFile&) = delete;
+
+    ~MappedSceneFile() {
+	close();
+    }
+
+    bool open(const std::string& path) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+	    std::cerr << "ERROR::SCENE::OPEN_FAILED " << path << std::endl;
+	    return false;
+	}
+
+	struct stat st{};
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SceneFileHeader)) {
+	    std::cerr << "ERROR::SCENE::TRUNCATED " << path << std::endl;
+	    ::close(fd);
+	    return false;
+	}
+
+	void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (mapping == MAP_FAILED) {
+	    std::cerr << "ERROR::SCENE::MMAP_FAILED " << path << std::endl;
+	    return false;
+	}
+
+	// Blobs are streamed to the driver front to back
+	madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+	data = static_cast<const uint8_t*>(mapping);
+	size = st.st_size;
+
+	if (!validate()) {
+	    std::cerr << "ERROR::SCENE::INVALID " << path << std::endl;
+	    close();
+	    return false;
+	}
+
+	return true;
+    }
+
+    void close() {
+	if (data != nullptr) {
+	    munmap(const_cast<uint8_t*>(data), size);
+	    data = nullptr;
+	    size = 0;
+	}
+    }
+
+    const SceneFileHeader& header() const {
+	return *reinterpret_cast<const SceneFileHeader*>(data);
+    }
+
+    const SceneFileMesh* meshes() const {
+	return reinterpret_cast<const SceneFileMesh*>(data + header().meshTableOffset);
+    }
+
+    const SceneFileInstance* instances() const {
+	return reinterpret_cast<const SceneFileInstance*>(data + header().instanceTableOffset);
+    }
+
+    const void* vertexData(const SceneFileMesh& mesh) const {
+	return data + mesh.vertexOffset;
+    }
+
+    const void* indexData(const SceneFileMesh& mesh) const {
+	return data + mesh.indexOffset;
+    }
+
+private:
+    bool inBounds(uint64_t offset, uint64_t bytes) const {
+	return offset <= size && bytes <= size - offset;
+    }
+
+    bool validate() const {
+	const SceneFileHeader& h = header();
+
+	if (std::memcmp(h.magic, sceneFileMagic, sizeof(h.magic)) != 0
+	    || h.version != sceneFileVersion
+	    || h.fileSize != size
+	    || h.meshTableOffset % alignof(SceneFileMesh) != 0
+	    || h.instanceTableOffset % alignof(SceneFileInstance) != 0
+	    || !inBounds(h.meshTableOffset, (uint64_t)h.meshCount * sizeof(SceneFileMesh))
+	    || h.instanceCount > size / sizeof(SceneFileInstance)
+	    || !inBounds(h.instanceTableOffset, h.instanceCount * sizeof(SceneFileInstance))) {
+	    return false;
+	}
+
+	for (uint32_t i = 0; i < h.meshCount; ++i) {
+	    const SceneFileMesh& mesh = meshes()[i];
+
+	    if (mesh.indexType != GL_UNSIGNED_BYTE
+		&& mesh.indexType != GL_UNSIGNED_SHORT
+		&& mesh.indexType != GL_UNSIGNED_INT) {
+		return false;
+	    }
+
+	    if (mesh.positionFormat > static_cast<uint8_t>(PositionFormat::Snorm10)
+		|| mesh.colorFormat > static_cast<uint8_t>(ColorFormat::Unorm8)) {
+		return false;
+	    }
+
+	    // Blobs are handed to GL as they are, so they must be laid out
+	    // exactly as the writer lays them out
+	    uint64_t stride = mesh.vertexFormat().stride();
+	    if (mesh.vertexOffset % sceneFileAlignment != 0
+		|| mesh.indexOffset % sceneFileAlignment != 0
+		|| mesh.vertexSize % stride != 0) {
+		return false;
+	    }
+
+	    if (!inBounds(mesh.vertexOffset, mesh.vertexSize)
+		|| !inBounds(mesh.indexOffset, (uint64_t)mesh.indexCount * indexTypeSize(mesh.indexType))) {
+		return false;
+	    }
+	}
+
+	for (uint64_t i = 0; i < h.instanceCount; ++i) {
+	    if (instances()[i].mesh >= h.meshCount) {
+		return false;
+	    }
+	}
+
+	return true;
+    }
+};
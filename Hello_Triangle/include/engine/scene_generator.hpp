@@ -0,0 +1,208 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+enum class SceneLayout {
+    Grid,       // square grid on the XY plane
+    Scatter,    // uniform in a flat box
+    Clustered,  // gaussian blobs around random centers
+    Overlap,    // a column along the view axis, every object covering the same pixels
+    Orbits      // grid of hubs, each swinging a chain of smaller satellites around
+};
+
+inline bool parseSceneLayout(const std::string& name, SceneLayout& layout) {
+    if (name == "grid") {
+	layout = SceneLayout::Grid;
+    } else if (name == "scatter") {
+	layout = SceneLayout::Scatter;
+    } else if (name == "clustered") {
+	layout = SceneLayout::Clustered;
+    } else if (name == "overlap") {
+	layout = SceneLayout::Overlap;
+    } else if (name == "orbits") {
+	layout = SceneLayout::Orbits;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+struct SceneGeneratorOptions {
+    SceneLayout layout = SceneLayout::Grid;
+    uint64_t count = 1000;
+    uint64_t seed = 1;
+    float translucentRatio = 1.0f / 3.0f;
+    float spacing = 1.0f;           // average distance between neighbours
+    uint32_t objectsPerCluster = 1000;
+    uint32_t orbitChain = 4;        // objects per hub and satellite chain
+    float staticRatio = 0.0f;       // fraction of objects that do not spin
+};
+
+// One placed object with its motion: spin is in degrees per second about
+// the X and Y axes. A child's placement is relative to its parent, which
+// is always emitted before it.
+struct GeneratedObject {
+    static constexpr uint64_t noParent = ~0ull;
+
+    glm::mat4 placement;
+    glm::vec2 spin;
+    bool translucent;
+    uint64_t parent;    // index of the parent object, or noParent
+};
+
+// Small counter-based generator (splitmix64). Unlike the std distributions,
+// its output is specified exactly, so a seed gives the same scene with
+// every standard library.
+class SceneRandom {
+private:
+    uint64_t state;
+
+public:
+    explicit SceneRandom(uint64_t seed)
+        : state{seed}
+    {}
+
+    uint64_t next() {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1)
+    float uniform() {
+	return (float)(next() >> 40) * (1.0f / 16777216.0f);
+    }
+
+    float uniform(float low, float high) {
+	return low + (high - low) * uniform();
+    }
+
+    // Standard normal, Box-Muller
+    float normal() {
+	float u = std::max(uniform(), 1e-7f);
+	float v = uniform();
+	return std::sqrt(-2.0f * std::log(u)) * std::cos(6.2831853f * v);
+    }
+};
+
+// Side of the square around the origin the layout occupies on the XY plane,
+// for framing the camera. Density stays constant as the count grows.
+inline float generatedSceneExtent(const SceneGeneratorOptions& options) {
+    if (options.layout == SceneLayout::Overlap) {
+	return 2.0f * options.spacing;
+    }
+    return std::ceil(std::sqrt((float)std::max<uint64_t>(options.count, 1))) * options.spacing;
+}
+
+// Calls emit(const GeneratedObject&) once per object, in a fixed order.
+// Objects are produced one at a time so even 10^7 of them never exist twice.
+template <typename Emit>
+void generateScene(const SceneGeneratorOptions& options, Emit&& emit) {
+    SceneRandom random(options.seed);
+
+    float extent = generatedSceneExtent(options);
+    float half = extent * 0.5f;
+    float scale = options.spacing * 0.5f;
+    uint64_t side = (uint64_t)std::ceil(std::sqrt((double)std::max<uint64_t>(options.count, 1)));
+
+    // Cluster centers come from their own stream so they do not depend on
+    // the per-object draws
+    SceneRandom clusterRandom(options.seed ^ 0xC1057E55ull);
+    uint64_t objectsPerCluster = std::max<uint32_t>(options.objectsPerCluster, 1);
+    uint64_t clusterCount = std::max<uint64_t>((options.count + objectsPerCluster - 1) / objectsPerCluster, 1);
+    float clusterSigma = extent / (4.0f * std::sqrt((float)clusterCount));
+    glm::vec3 clusterCenter(0.0f);
+
+    // Likewise for picking the static objects, so the other draws, and with
+    // them the scene, stay the same whatever the ratio
+    SceneRandom staticRandom(options.seed ^ 0x57A71Cull);
+
+    // Hubs sit on a grid of their own, as far apart as the chains need
+    uint64_t orbitChain = std::max<uint32_t>(options.orbitChain, 1);
+    uint64_t hubCount = std::max<uint64_t>((options.count + orbitChain - 1) / orbitChain, 1);
+    uint64_t hubSide = (uint64_t)std::ceil(std::sqrt((double)hubCount));
+    float hubSpacing = extent / (float)hubSide;
+
+    for (uint64_t i = 0; i < options.count; ++i) {
+	glm::vec3 position(0.0f);
+	float objectScale = scale;
+	uint64_t parent = GeneratedObject::noParent;
+
+	switch (options.layout) {
+	    case SceneLayout::Grid:
+		position = glm::vec3(
+		    ((float)(i % side) + 0.5f) * options.spacing - half,
+		    ((float)(i / side) + 0.5f) * options.spacing - half,
+		    0.0f
+		);
+		break;
+	    case SceneLayout::Scatter:
+		position = glm::vec3(
+		    random.uniform(-half, half),
+		    random.uniform(-half, half),
+		    random.uniform(-options.spacing, options.spacing)
+		);
+		break;
+	    case SceneLayout::Clustered:
+		if (i % objectsPerCluster == 0) {
+		    clusterCenter = glm::vec3(
+			clusterRandom.uniform(-half, half),
+			clusterRandom.uniform(-half, half),
+			0.0f
+		    );
+		}
+		position = clusterCenter + glm::vec3(
+		    random.normal() * clusterSigma,
+		    random.normal() * clusterSigma,
+		    random.normal() * options.spacing
+		);
+		break;
+	    case SceneLayout::Overlap:
+		// Large objects stacked away from the camera
+		objectScale = options.spacing * 1.5f;
+		position = glm::vec3(
+		    random.uniform(-0.1f, 0.1f) * options.spacing,
+		    random.uniform(-0.1f, 0.1f) * options.spacing,
+		    -random.uniform() * 0.01f * options.spacing * (float)options.count
+		);
+		break;
+	    case SceneLayout::Orbits:
+		if (i % orbitChain == 0) {
+		    uint64_t hub = i / orbitChain;
+		    position = glm::vec3(
+			((float)(hub % hubSide) + 0.5f) * hubSpacing - half,
+			((float)(hub / hubSide) + 0.5f) * hubSpacing - half,
+			0.0f
+		    );
+		    objectScale = hubSpacing * 0.12f;
+		} else {
+		    // Beside the previous link, in its space, at half its size
+		    parent = i - 1;
+		    position = glm::vec3(2.0f, 0.0f, 0.0f);
+		    objectScale = 0.5f;
+		}
+		break;
+	}
+
+	GeneratedObject object;
+	object.placement = glm::translate(glm::mat4(1.0f), position);
+	object.placement = glm::rotate(object.placement, random.uniform(0.0f, 6.2831853f), glm::vec3(0.0f, 1.0f, 0.0f));
+	object.placement = glm::rotate(object.placement, random.uniform(0.0f, 6.2831853f), glm::vec3(1.0f, 0.0f, 0.0f));
+	object.placement = glm::scale(object.placement, glm::vec3(objectScale));
+	object.spin = glm::vec2(random.uniform(-360.0f, 360.0f), random.uniform(-720.0f, 720.0f));
+	object.translucent = random.uniform() < options.translucentRatio;
+	if (staticRandom.uniform() < options.staticRatio) {
+	    object.spin = glm::vec2(0.0f);
+	}
+	object.parent = parent;
+
+	emit(object);
+    }
+}
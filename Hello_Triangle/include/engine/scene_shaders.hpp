@@ -0,0 +1,149 @@
+#pragma once
+
+// GLSL sources of the pyramid programs, shared by the viewer and the
+// benchmark
+
+// Vertex Shader and Fragment Shader
+inline const char* vertexShaderSource = R"(
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    float time;
+};
+layout (std140, binding = 1) uniform Object {
+    mat4 model;
+};
+out vec3 vertexColor;
+void main()
+{
+    gl_Position = viewProjection * model * vec4(aPos, 1.0f);
+    vertexColor = aColor;
+})";
+
+inline const char* fragmentShaderSource = R"(
+#version 460 core
+in vec3 vertexColor;
+uniform float alpha;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vec4(vertexColor, alpha);
+})";
+
+// Translucent pyramids are drawn instanced, one draw per material batch.
+// Each instance reads its row from a storage buffer of object indices and
+// its model matrix from the transform buffer, so only indices are uploaded
+// per frame.
+inline const char* translucentVertexShaderSource = R"(
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    float time;
+};
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+layout (std430, binding = 1) readonly buffer Instances {
+    uint rows[];
+};
+out vec3 vertexColor;
+void main()
+{
+    gl_Position = viewProjection * transforms[rows[gl_InstanceID]] * vec4(aPos, 1.0f);
+    vertexColor = aColor;
+})";
+
+// Writes weighted blended OIT accumulation and revealage
+inline const char* translucentFragmentShaderSource = R"(
+#version 460 core
+in vec3 vertexColor;
+uniform float alpha;
+layout (location = 0) out vec4 accum;
+layout (location = 1) out float reveal;
+void main()
+{
+    float weight = clamp(
+        pow(min(1.0f, alpha * 10.0f) + 0.01f, 3.0f) * 1e8 * pow(1.0f - gl_FragCoord.z * 0.9f, 3.0f),
+        1e-2, 3e3
+    );
+    accum = vec4(vertexColor * alpha, alpha) * weight;
+    reveal = alpha;
+})";
+
+// Opaque pyramids drawn instanced, through indirect commands or one by one
+// from recorded command buffers. Each draw's base instance selects where
+// its transforms start in the storage buffer, so one multi-draw can address
+// any object and a single draw needs no per-object uniforms.
+inline const char* indirectVertexShaderSource = R"(
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    float time;
+};
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+out vec3 vertexColor;
+void main()
+{
+    gl_Position = viewProjection * transforms[gl_BaseInstance + gl_InstanceID] * vec4(aPos, 1.0f);
+    vertexColor = aColor;
+})";
+
+// Frustum culls one object per invocation and appends an indirect draw for
+// each survivor, counted in drawCount for glMultiDrawElementsIndirectCount
+inline const char* cullComputeShaderSource = R"(
+#version 460 core
+layout (local_size_x = 256) in;
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+layout (std430, binding = 1) writeonly buffer Commands {
+    DrawCommand commands[];
+};
+layout (std430, binding = 2) buffer Count {
+    uint drawCount;
+};
+uniform vec4 planes[6];
+uniform uint objectCount;
+uniform uint indexCount;
+uniform uint firstIndex;
+uniform float boundingRadius;
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= objectCount) {
+        return;
+    }
+
+    mat4 m = transforms[i];
+    vec3 center = m[3].xyz;
+    float radius = boundingRadius * max(length(m[0].xyz), max(length(m[1].xyz), length(m[2].xyz)));
+
+    for (int p = 0; p < 6; ++p) {
+        if (dot(planes[p].xyz, center) + planes[p].w < -radius) {
+            return;
+        }
+    }
+
+    commands[atomicAdd(drawCount, 1u)] = DrawCommand(indexCount, 1u, firstIndex, 0, i);
+})";
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Stable name of an object in a store. The generation tells a live entity
+// from an older one whose index has been reused.
+struct Entity {
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator==(const Entity& other) const {
+	return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const Entity& other) const {
+	return !(*this == other);
+    }
+};
+
+// Entity-component storage for entities that all share one set of
+// components (an archetype). Each component type lives in its own dense
+// array and row i of every array belongs to the same entity, so a system
+// iterates just the arrays it needs, in lockstep, without lookups.
+//
+// Destroying an entity moves the last row into its place, keeping the
+// arrays dense; rows are therefore not stable, entities are. Threads may
+// work on different columns at once as long as no entity is created or
+// destroyed meanwhile.
+template <typename... Components>
+class Archetype {
+private:
+    static constexpr uint32_t noRow = std::numeric_limits<uint32_t>::max();
+
+    std::tuple<std::vector<Components>...> columns;
+    std::vector<Entity> rowEntities;    // entity of each row
+    std::vector<uint32_t> entityRows;   // row of each entity index, or noRow
+    std::vector<uint32_t> generations;  // current generation of each entity index
+    std::vector<uint32_t> freeIndices;
+
+public:
+    Archetype() = default;
+
+    Archetype(const Archetype&) = delete;
+    Archetype& operator=(const Archetype&) = delete;
+
+    Archetype(Archetype&&) noexcept = default;
+    Archetype& operator=(Archetype&&) noexcept = default;
+
+    void reserve(size_t count) {
+	std::apply([count](auto&... column) { (column.reserve(count), ...); }, columns);
+	rowEntities.reserve(count);
+	entityRows.reserve(count);
+	generations.reserve(count);
+    }
+
+    Entity create(Components... components) {
+	Entity entity;
+	if (!freeIndices.empty()) {
+	    entity.index = freeIndices.back();
+	    freeIndices.pop_back();
+	} else {
+	    entity.index = (uint32_t)generations.size();
+	    generations.push_back(0);
+	    entityRows.push_back(noRow);
+	}
+	entity.generation = generations[entity.index];
+
+	entityRows[entity.index] = (uint32_t)rowEntities.size();
+	rowEntities.push_back(entity);
+	std::apply([&](auto&... column) { (column.push_back(std::move(components)), ...); }, columns);
+
+	return entity;
+    }
+
+    bool alive(Entity entity) const {
+	return entity.index < generations.size()
+	    && generations[entity.index] == entity.generation
+	    && entityRows[entity.index] != noRow;
+    }
+
+    // Removes the entity, moving the last row into its place
+    void destroy(Entity entity) {
+	if (!alive(entity)) {
+	    return;
+	}
+
+	uint32_t row = entityRows[entity.index];
+	uint32_t last = (uint32_t)rowEntities.size() - 1;
+
+	if (row != last) {
+	    std::apply([row, last](auto&... column) { ((column[row] = std::move(column[last])), ...); }, columns);
+	    rowEntities[row] = rowEntities[last];
+	    entityRows[rowEntities[row].index] = row;
+	}
+	std::apply([](auto&... column) { (column.pop_back(), ...); }, columns);
+	rowEntities.pop_back();
+
+	entityRows[entity.index] = noRow;
+	++generations[entity.index];
+	freeIndices.push_back(entity.index);
+    }
+
+    // Row of a live entity
+    uint32_t row(Entity entity) const {
+	return entityRows[entity.index];
+    }
+
+    Entity entity(size_t row) const {
+	return rowEntities[row];
+    }
+
+    size_t size() const {
+	return rowEntities.size();
+    }
+
+    template <typename T>
+    std::vector<T>& column() {
+	return std::get<std::vector<T>>(columns);
+    }
+
+    template <typename T>
+    const std::vector<T>& column() const {
+	return std::get<std::vector<T>>(columns);
+    }
+
+    template <typename T>
+    T& get(Entity entity) {
+	return column<T>()[row(entity)];
+    }
+
+    template <typename T>
+    const T& get(Entity entity) const {
+	return column<T>()[row(entity)];
+    }
+};
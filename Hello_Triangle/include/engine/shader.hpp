@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <engine/gl_handle.hpp>
+
+#include <iostream>
+
+// Compiles a single shader stage. Returns an empty handle and prints the info
+// log on failure.
+inline Shader compileShader(GLenum type, const char* source, const char* name) {
+    int success{0};
+    char infoLog[512] = {0};
+
+    Shader shader(glCreateShader(type));
+    glShaderSource(shader.get(), 1, &source, NULL);
+    glCompileShader(shader.get());
+
+    glGetShaderiv(shader.get(), GL_COMPILE_STATUS, &success);
+    if(!success) {
+	glGetShaderInfoLog(shader.get(), 512, NULL, infoLog);
+	std::cerr << "ERROR::SHADER::" << name << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+	return Shader();
+    }
+
+    return shader;
+}
+
+// Compiles and links a vertex/fragment program. Returns an empty handle on
+// failure. The shader objects are released once linked.
+inline Program createProgram(const char* vertexSource, const char* fragmentSource) {
+    int success{0};
+    char infoLog[512] = {0};
+
+    Shader vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource, "VERTEX");
+    if (!vertexShader) {
+	return Program();
+    }
+
+    Shader fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource, "FRAGMENT");
+    if (!fragmentShader) {
+	return Program();
+    }
+
+    Program program = Program::create();
+    glAttachShader(program.get(), vertexShader.get());
+    glAttachShader(program.get(), fragmentShader.get());
+    glLinkProgram(program.get());
+
+    glGetProgramiv(program.get(), GL_LINK_STATUS, &success);
+    if(!success) {
+	glGetProgramInfoLog(program.get(), 512, NULL, infoLog);
+	std::cerr << "ERROR::SHADER::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
+	return Program();
+    }
+
+    return program;
+}
+
+// Compiles and links a compute program. Returns an empty handle on failure.
+inline Program createComputeProgram(const char* computeSource) {
+    int success{0};
+    char infoLog[512] = {0};
+
+    Shader computeShader = compileShader(GL_COMPUTE_SHADER, computeSource, "COMPUTE");
+    if (!computeShader) {
+	return Program();
+    }
+
+    Program program = Program::create();
+    glAttachShader(program.get(), computeShader.get());
+    glLinkProgram(program.get());
+
+    glGetProgramiv(program.get(), GL_LINK_STATUS, &success);
+    if(!success) {
+	glGetProgramInfoLog(program.get(), 512, NULL, infoLog);
+	std::cerr << "ERROR::SHADER::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
+	return Program();
+    }
+
+    return program;
+}
@@ -0,0 +1,442 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <engine/mesh.hpp>
+#include <engine/vertex_transform.hpp>
+#include <engine/worker_pool.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// One object for the software rasterizer: its mesh, model transform and
+// material, drawn the way the GL path draws that material
+struct SoftwareObject {
+    const MeshData* mesh;
+    glm::mat4 model;
+    float alpha;
+    bool translucent;
+};
+
+// CPU fallback for machines without a usable GPU, and a reference for the
+// GL renderer. It reproduces the GL path: opaque triangles depth tested
+// with GL_LESS, then translucent ones through the same weighted blended
+// OIT formulas, resolved over the opaque image.
+//
+// Objects are transformed, clipped and binned into screen tiles in
+// parallel, one task per range of objects; the tiles are then rasterized
+// in parallel, each walking the bins of every task in object order, so the
+// image does not depend on the thread count. Vertices are snapped to 1/256
+// of a pixel like GL hardware, which keeps the edge functions integers
+// that doubles hold exactly, and edges follow the top-left fill rule.
+class SoftwareRasterizer {
+public:
+    static constexpr int tileSize = 64;
+    static constexpr size_t objectsPerTask = 4096;
+
+private:
+    static constexpr double subpixelScale = 256.0;
+
+    // Clip space position and the attribute interpolated across the triangle
+    struct ClipVertex {
+	glm::vec4 position;
+	glm::vec3 color;
+    };
+
+    struct Triangle {
+	// Edge i, opposite vertex i, is a[i] * x + b[i] * y + c[i] at subpixel
+	// (x, y); it is >= 0 exactly for the pixels the triangle owns
+	double a[3], b[3], c[3];
+	float invArea;
+	float z[3];             // window depth
+	float invW[3];
+	glm::vec3 color[3];     // divided by w, for perspective correction
+	int minX, minY, maxX, maxY;
+	float alpha;
+    };
+
+    // What one task produced: its triangles and, per tile, the indices of
+    // those touching it. clip holds the current object's vertices.
+    struct Bins {
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> opaque;
+	std::vector<std::vector<uint32_t>> translucent;
+	TransformedPositions clip;
+    };
+
+    int width, height;
+    int tilesX, tilesY;
+
+    // Rows bottom to top, as GL stores them
+    std::vector<uint8_t> color;     // RGB, like the RGBA8 scene target
+    std::vector<float> depth;
+    std::vector<glm::vec4> accum;   // OIT accumulation
+    std::vector<float> reveal;      // OIT revealage, kept at 8 bits like its R8 target
+
+    std::vector<Bins> bins;
+
+    // Mesh positions in the layout the vertex kernel reads, built the first
+    // time a mesh is drawn. Meshes must stay alive and unchanged.
+    std::unordered_map<const MeshData*, PositionBlocks> meshPositions;
+
+    static float toUnorm8(float value) {
+	return std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f) / 255.0f;
+    }
+
+    // Keeps the part of a convex polygon with dot(plane, position) >= 0
+    static size_t clipPolygon(const ClipVertex* in, size_t count, const glm::vec4& plane, ClipVertex* out) {
+	size_t written = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+	    const ClipVertex& from = in[i];
+	    const ClipVertex& to = in[(i + 1) % count];
+	    float dFrom = glm::dot(plane, from.position);
+	    float dTo = glm::dot(plane, to.position);
+
+	    if (dFrom >= 0.0f) {
+		out[written++] = from;
+	    }
+	    if ((dFrom >= 0.0f) != (dTo >= 0.0f)) {
+		float t = dFrom / (dFrom - dTo);
+		out[written++] = {
+		    from.position + (to.position - from.position) * t,
+		    from.color + (to.color - from.color) * t
+		};
+	    }
+	}
+	return written;
+    }
+
+    void addTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, float alpha, bool translucent, Bins& out) const {
+	const ClipVertex* v[3] = { &v0, &v1, &v2 };
+	double x[3], y[3];
+	Triangle triangle;
+
+	for (int i = 0; i < 3; ++i) {
+	    const glm::vec4& p = v[i]->position;
+	    if (p.w <= 0.0f) {
+		return;
+	    }
+
+	    float invW = 1.0f / p.w;
+	    x[i] = std::round(((p.x * invW) * 0.5f + 0.5f) * (float)width * subpixelScale);
+	    y[i] = std::round(((p.y * invW) * 0.5f + 0.5f) * (float)height * subpixelScale);
+	    triangle.z[i] = (p.z * invW) * 0.5f + 0.5f;
+	    triangle.invW[i] = invW;
+	    triangle.color[i] = v[i]->color * invW;
+	}
+
+	// Both windings are drawn, as face culling is off in the GL path;
+	// clockwise triangles are flipped so the inside is always positive
+	double area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if (area == 0.0) {
+	    return;
+	}
+	if (area < 0.0) {
+	    std::swap(x[1], x[2]);
+	    std::swap(y[1], y[2]);
+	    std::swap(triangle.z[1], triangle.z[2]);
+	    std::swap(triangle.invW[1], triangle.invW[2]);
+	    std::swap(triangle.color[1], triangle.color[2]);
+	    area = -area;
+	}
+
+	for (int i = 0; i < 3; ++i) {
+	    int j = (i + 1) % 3, k = (i + 2) % 3;
+	    triangle.a[i] = y[j] - y[k];
+	    triangle.b[i] = x[k] - x[j];
+	    triangle.c[i] = -triangle.a[i] * x[j] - triangle.b[i] * y[j];
+
+	    // Top-left rule: left edges and horizontal top edges own the
+	    // pixels exactly on them. Everything is an integer, so > 0
+	    // becomes >= 0 by moving the other edges in by one.
+	    bool topLeft = triangle.a[i] > 0.0 || (triangle.a[i] == 0.0 && triangle.b[i] < 0.0);
+	    if (!topLeft) {
+		triangle.c[i] -= 1.0;
+	    }
+	}
+	triangle.invArea = (float)(1.0 / area);
+	triangle.alpha = alpha;
+
+	// Pixels whose centers fall inside the bounding box
+	double half = subpixelScale * 0.5;
+	triangle.minX = std::max((int)std::ceil((std::min({ x[0], x[1], x[2] }) - half) / subpixelScale), 0);
+	triangle.minY = std::max((int)std::ceil((std::min({ y[0], y[1], y[2] }) - half) / subpixelScale), 0);
+	triangle.maxX = std::min((int)std::floor((std::max({ x[0], x[1], x[2] }) - half) / subpixelScale), width - 1);
+	triangle.maxY = std::min((int)std::floor((std::max({ y[0], y[1], y[2] }) - half) / subpixelScale), height - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+	    return;
+	}
+
+	uint32_t index = (uint32_t)out.triangles.size();
+	out.triangles.push_back(triangle);
+
+	auto& tiles = translucent ? out.translucent : out.opaque;
+	for (int ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ++ty) {
+	    for (int tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; ++tx) {
+		tiles[ty * tilesX + tx].push_back(index);
+	    }
+	}
+    }
+
+    void addObject(const SoftwareObject& object, const glm::mat4& viewProjection, Bins& out) const {
+	static const glm::vec4 planes[6] = {
+	    { 1.0f, 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f, 1.0f },
+	    { 0.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f, 1.0f },
+	    { 0.0f, 0.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, -1.0f, 1.0f }
+	};
+
+	const MeshData& mesh = *object.mesh;
+	transformPositions(viewProjection * object.model, meshPositions.at(&mesh), out.clip);
+
+	for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+	    // A triangle clipped by all six planes has at most nine corners
+	    ClipVertex polygon[2][9];
+	    size_t count = 3;
+	    bool inside = true;
+
+	    for (int i = 0; i < 3; ++i) {
+		uint32_t index = mesh.indices[t + i];
+		polygon[0][i] = { out.clip[index], mesh.colors[index] };
+		for (const glm::vec4& plane : planes) {
+		    inside = inside && glm::dot(plane, polygon[0][i].position) >= 0.0f;
+		}
+	    }
+
+	    int current = 0;
+	    if (!inside) {
+		for (const glm::vec4& plane : planes) {
+		    count = clipPolygon(polygon[current], count, plane, polygon[1 - current]);
+		    current = 1 - current;
+		    if (count < 3) {
+			break;
+		    }
+		}
+	    }
+
+	    for (size_t i = 2; i < count; ++i) {
+		addTriangle(polygon[current][0], polygon[current][i - 1], polygon[current][i], object.alpha, object.translucent, out);
+	    }
+	}
+    }
+
+    // Bit k is set if pixel (x + k, y) is covered, for k in [0, 4)
+    static int coverage4(const Triangle& triangle, int x, int y) {
+	double px = x * subpixelScale + subpixelScale * 0.5;
+	double py = y * subpixelScale + subpixelScale * 0.5;
+
+#ifdef __SSE2__
+	__m128d x01 = _mm_set_pd(px + subpixelScale, px);
+	__m128d x23 = _mm_set_pd(px + 3.0 * subpixelScale, px + 2.0 * subpixelScale);
+	__m128d zero = _mm_setzero_pd();
+	__m128d inside01 = _mm_cmpeq_pd(zero, zero);
+	__m128d inside23 = inside01;
+
+	for (int i = 0; i < 3; ++i) {
+	    __m128d a = _mm_set1_pd(triangle.a[i]);
+	    __m128d row = _mm_set1_pd(triangle.b[i] * py + triangle.c[i]);
+	    inside01 = _mm_and_pd(inside01, _mm_cmpge_pd(_mm_add_pd(_mm_mul_pd(a, x01), row), zero));
+	    inside23 = _mm_and_pd(inside23, _mm_cmpge_pd(_mm_add_pd(_mm_mul_pd(a, x23), row), zero));
+	}
+
+	return _mm_movemask_pd(inside01) | (_mm_movemask_pd(inside23) << 2);
+#else
+	int mask = 0;
+	for (int k = 0; k < 4; ++k) {
+	    double sx = px + k * subpixelScale;
+	    bool inside = true;
+	    for (int i = 0; i < 3; ++i) {
+		inside = inside && triangle.a[i] * sx + triangle.b[i] * py + triangle.c[i] >= 0.0;
+	    }
+	    mask |= (int)inside << k;
+	}
+	return mask;
+#endif
+    }
+
+    // Calls shade(pixel, z, color) for every covered pixel of the triangle
+    // inside the tile
+    template <typename Shade>
+    void rasterize(const Triangle& triangle, int x0, int y0, int x1, int y1, Shade&& shade) const {
+	x0 = std::max(x0, triangle.minX);
+	y0 = std::max(y0, triangle.minY);
+	x1 = std::min(x1, triangle.maxX);
+	y1 = std::min(y1, triangle.maxY);
+
+	for (int y = y0; y <= y1; ++y) {
+	    double py = y * subpixelScale + subpixelScale * 0.5;
+
+	    for (int x = x0; x <= x1; x += 4) {
+		int mask = coverage4(triangle, x, y);
+		if (x1 - x < 3) {
+		    mask &= (1 << (x1 - x + 1)) - 1;
+		}
+
+		for (; mask != 0; mask &= mask - 1) {
+		    int k = 0;
+		    while (!(mask & (1 << k))) {
+			++k;
+		    }
+
+		    double px = (x + k) * subpixelScale + subpixelScale * 0.5;
+		    float l[3];
+		    for (int i = 0; i < 3; ++i) {
+			l[i] = (float)(triangle.a[i] * px + triangle.b[i] * py + triangle.c[i]) * triangle.invArea;
+		    }
+
+		    // Depth is linear in screen space, the color is not
+		    float z = l[0] * triangle.z[0] + l[1] * triangle.z[1] + l[2] * triangle.z[2];
+		    float invW = l[0] * triangle.invW[0] + l[1] * triangle.invW[1] + l[2] * triangle.invW[2];
+		    glm::vec3 c = (l[0] * triangle.color[0] + l[1] * triangle.color[1] + l[2] * triangle.color[2]) / invW;
+
+		    shade((size_t)y * width + x + k, z, c);
+		}
+	    }
+	}
+    }
+
+    void renderTile(int tile) {
+	int x0 = (tile % tilesX) * tileSize;
+	int y0 = (tile / tilesX) * tileSize;
+	int x1 = std::min(x0 + tileSize, width) - 1;
+	int y1 = std::min(y0 + tileSize, height) - 1;
+
+	for (int y = y0; y <= y1; ++y) {
+	    for (int x = x0; x <= x1; ++x) {
+		size_t pixel = (size_t)y * width + x;
+		color[pixel * 3] = color[pixel * 3 + 1] = color[pixel * 3 + 2] = 0;
+		depth[pixel] = 1.0f;
+		accum[pixel] = glm::vec4(0.0f);
+		reveal[pixel] = 1.0f;
+	    }
+	}
+
+	for (const Bins& task : bins) {
+	    for (uint32_t index : task.opaque[tile]) {
+		rasterize(task.triangles[index], x0, y0, x1, y1, [this](size_t pixel, float z, const glm::vec3& c) {
+		    if (z < depth[pixel]) {
+			depth[pixel] = z;
+			for (int i = 0; i < 3; ++i) {
+			    color[pixel * 3 + i] = (uint8_t)std::lround(std::clamp(c[i], 0.0f, 1.0f) * 255.0f);
+			}
+		    }
+		});
+	    }
+	}
+
+	for (const Bins& task : bins) {
+	    for (uint32_t index : task.translucent[tile]) {
+		float alpha = task.triangles[index].alpha;
+		float alphaWeight = std::pow(std::min(1.0f, alpha * 10.0f) + 0.01f, 3.0f) * 1e8f;
+
+		rasterize(task.triangles[index], x0, y0, x1, y1, [this, alpha, alphaWeight](size_t pixel, float z, const glm::vec3& c) {
+		    if (z < depth[pixel]) {
+			float weight = std::clamp(alphaWeight * std::pow(1.0f - z * 0.9f, 3.0f), 1e-2f, 3e3f);
+			accum[pixel] += glm::vec4(c * alpha, alpha) * weight;
+			reveal[pixel] = toUnorm8(reveal[pixel] * (1.0f - alpha));
+		    }
+		});
+	    }
+	}
+
+	// Composite, as WeightedBlendedOIT::composite() blends it
+	for (int y = y0; y <= y1; ++y) {
+	    for (int x = x0; x <= x1; ++x) {
+		size_t pixel = (size_t)y * width + x;
+		if (reveal[pixel] == 1.0f) {
+		    continue;
+		}
+
+		glm::vec4 accumulation = accum[pixel];
+		if (std::isinf(std::max(std::abs(accumulation.x), std::max(std::abs(accumulation.y), std::abs(accumulation.z))))) {
+		    accumulation = glm::vec4(accumulation.w);
+		}
+
+		float coverage = 1.0f - reveal[pixel];
+		for (int i = 0; i < 3; ++i) {
+		    float average = accumulation[i] / std::max(accumulation.w, 1e-5f);
+		    float opaque = color[pixel * 3 + i] / 255.0f;
+		    color[pixel * 3 + i] = (uint8_t)std::lround(std::clamp(average * coverage + opaque * (1.0f - coverage), 0.0f, 1.0f) * 255.0f);
+		}
+	    }
+	}
+    }
+
+public:
+    SoftwareRasterizer()
+        : width{0},
+          height{0},
+          tilesX{0},
+          tilesY{0}
+    {}
+
+    void resize(int newWidth, int newHeight) {
+	if (newWidth == width && newHeight == height) {
+	    return;
+	}
+
+	width = newWidth;
+	height = newHeight;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+
+	size_t pixels = (size_t)width * height;
+	color.resize(pixels * 3);
+	depth.resize(pixels);
+	accum.resize(pixels);
+	reveal.resize(pixels);
+    }
+
+    // Renders the objects, splitting both the binning and the tiles across
+    // the worker pool
+    void render(const std::vector<SoftwareObject>& objects, const glm::mat4& viewProjection, WorkerPool& workers) {
+	size_t taskCount = std::max<size_t>((objects.size() + objectsPerTask - 1) / objectsPerTask, 1);
+	size_t tileCount = (size_t)tilesX * tilesY;
+	bins.resize(taskCount);
+
+	for (const SoftwareObject& object : objects) {
+	    if (meshPositions.find(object.mesh) == meshPositions.end()) {
+		meshPositions[object.mesh].assign(object.mesh->positions);
+	    }
+	}
+
+	workers.run(taskCount, [&](size_t t) {
+	    Bins& task = bins[t];
+	    task.triangles.clear();
+	    task.opaque.resize(tileCount);
+	    task.translucent.resize(tileCount);
+	    for (size_t i = 0; i < tileCount; ++i) {
+		task.opaque[i].clear();
+		task.translucent[i].clear();
+	    }
+
+	    size_t end = std::min((t + 1) * objectsPerTask, objects.size());
+	    for (size_t i = t * objectsPerTask; i < end; ++i) {
+		addObject(objects[i], viewProjection, task);
+	    }
+	});
+
+	workers.run(tileCount, [this](size_t tile) {
+	    renderTile((int)tile);
+	});
+    }
+
+    // The image as tightly packed RGB, rows top to bottom, like
+    // SceneFramebuffer::readColor()
+    void readColor(std::vector<uint8_t>& rgb) const {
+	size_t rowSize = (size_t)width * 3;
+	rgb.resize(rowSize * height);
+	for (int y = 0; y < height; ++y) {
+	    std::copy_n(&color[(size_t)(height - 1 - y) * rowSize], rowSize, &rgb[(size_t)y * rowSize]);
+	}
+    }
+};
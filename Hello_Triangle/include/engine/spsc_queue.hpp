@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    // Written by the consumer / producer only, on separate cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+public:
+    explicit SpscQueue(size_t capacity)
+        : slots{},
+          mask{0},
+          head{0},
+          tail{0}
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side. Returns false if the queue is full.
+    bool push(T&& value) {
+	size_t t = tail.load(std::memory_order_relaxed);
+	if (t - head.load(std::memory_order_acquire) == slots.size()) {
+	    return false;
+	}
+
+	slots[t & mask] = std::move(value);
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool pop(T& value) {
+	size_t h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire)) {
+	    return false;
+	}
+
+	value = std::move(slots[h & mask]);
+	head.store(h + 1, std::memory_order_release);
+	return true;
+    }
+
+    bool empty() const {
+	return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Two-Level Segregated Fit allocator (Masmano et al. 2004) over an abstract
+// range [0, capacity). Block metadata lives on the CPU, so it can manage GPU
+// memory it never touches. Allocation and free are O(1): a first-level
+// bitmap picks the power-of-two class, a second-level bitmap one of its
+// linear subdivisions, and freed blocks merge with free physical neighbours.
+class TlsfAllocator {
+public:
+    static constexpr uint32_t invalid = ~0u;
+
+    struct Allocation {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t node;   // pass back to free(); invalid if the allocation failed
+    };
+
+private:
+    static constexpr uint32_t secondLevelLog2 = 4;
+    static constexpr uint32_t secondLevelCount = 1u << secondLevelLog2;
+    static constexpr uint32_t firstLevelCount = 64 - secondLevelLog2;
+
+    struct Block {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t prevPhysical, nextPhysical;
+	uint32_t prevFree, nextFree;
+	bool free;
+    };
+
+    std::vector<Block> blocks;
+    std::vector<uint32_t> unusedNodes;
+
+    uint64_t firstLevelBitmap;
+    uint32_t secondLevelBitmap[firstLevelCount];
+    uint32_t freeHeads[firstLevelCount][secondLevelCount];
+
+    uint64_t capacity;
+    uint64_t granularity;
+    uint64_t freeBytes;
+    size_t allocationCount;
+
+public:
+    // Every offset and size is a multiple of granularity (a power of two)
+    TlsfAllocator(uint64_t capacity, uint64_t granularity = 256)
+        : blocks{},
+          unusedNodes{},
+          firstLevelBitmap{0},
+          secondLevelBitmap{},
+          freeHeads{},
+          capacity{capacity & ~(granularity - 1)},
+          granularity{granularity},
+          freeBytes{0},
+          allocationCount{0}
+    {
+        for (auto& heads : freeHeads) {
+            for (auto& head : heads) {
+                head = invalid;
+            }
+        }
+
+        if (this->capacity > 0) {
+            uint32_t node = newNode({ 0, this->capacity, invalid, invalid, invalid, invalid, true });
+            insertFree(node);
+            freeBytes = this->capacity;
+        }
+    }
+
+    Allocation allocate(uint64_t size) {
+	size = roundUp(size == 0 ? 1 : size);
+
+	// Round the request up to the start of the next size class so that any
+	// block found in that class is large enough
+	uint64_t search = size;
+	uint32_t top = log2(search / granularity);
+	if (top >= secondLevelLog2) {
+	    search += (granularity << (top - secondLevelLog2)) - 1;
+	}
+
+	uint32_t fl, sl;
+	mapping(search, fl, sl);
+	uint32_t node = findFree(fl, sl);
+
+	// The rounded search can miss a block that fits exactly; try the precise class too
+	if (node == invalid) {
+	    mapping(size, fl, sl);
+	    for (uint32_t candidate = freeHeads[fl][sl]; candidate != invalid; candidate = blocks[candidate].nextFree) {
+		if (blocks[candidate].size >= size) {
+		    node = candidate;
+		    break;
+		}
+	    }
+	}
+
+	if (node == invalid) {
+	    return { 0, 0, invalid };
+	}
+
+	removeFree(node);
+
+	// Return the tail to the free lists
+	if (blocks[node].size > size) {
+	    Block& block = blocks[node];
+	    uint32_t rest = newNode({
+		block.offset + size, block.size - size,
+		node, block.nextPhysical, invalid, invalid, true
+	    });
+
+	    Block& split = blocks[node];
+	    if (split.nextPhysical != invalid) {
+		blocks[split.nextPhysical].prevPhysical = rest;
+	    }
+	    split.nextPhysical = rest;
+	    split.size = size;
+
+	    insertFree(rest);
+	}
+
+	blocks[node].free = false;
+	freeBytes -= size;
+	++allocationCount;
+
+	return { blocks[node].offset, size, node };
+    }
+
+    void free(const Allocation& allocation) {
+	uint32_t node = allocation.node;
+	if (node == invalid || blocks[node].free) {
+	    return;
+	}
+
+	freeBytes += blocks[node].size;
+	--allocationCount;
+
+	blocks[node].free = true;
+
+	uint32_t next = blocks[node].nextPhysical;
+	if (next != invalid && blocks[next].free) {
+	    removeFree(next);
+	    absorb(node, next);
+	}
+
+	uint32_t prev = blocks[node].prevPhysical;
+	if (prev != invalid && blocks[prev].free) {
+	    removeFree(prev);
+	    absorb(prev, node);
+	    node = prev;
+	}
+
+	insertFree(node);
+    }
+
+    uint64_t getCapacity() const {
+	return capacity;
+    }
+
+    uint64_t getFreeBytes() const {
+	return freeBytes;
+    }
+
+    size_t getAllocationCount() const {
+	return allocationCount;
+    }
+
+    // Walks the free lists; meant for statistics, not the hot path
+    uint64_t largestFreeBlock(size_t* freeBlockCount = nullptr) const {
+	uint64_t largest = 0;
+	size_t count = 0;
+
+	for (uint32_t fl = 0; fl < firstLevelCount; ++fl) {
+	    for (uint32_t sl = 0; sl < secondLevelCount; ++sl) {
+		for (uint32_t node = freeHeads[fl][sl]; node != invalid; node = blocks[node].nextFree) {
+		    largest = blocks[node].size > largest ? blocks[node].size : largest;
+		    ++count;
+		}
+	    }
+	}
+
+	if (freeBlockCount) {
+	    *freeBlockCount = count;
+	}
+
+	return largest;
+    }
+
+private:
+    static uint32_t log2(uint64_t value) {
+	return 63 - __builtin_clzll(value);
+    }
+
+    uint64_t roundUp(uint64_t size) const {
+	return (size + granularity - 1) & ~(granularity - 1);
+    }
+
+    // Size class of a block: first level is the power of two (in granules),
+    // second level the linear subdivision within it
+    void mapping(uint64_t size, uint32_t& fl, uint32_t& sl) const {
+	uint64_t units = size / granularity;
+
+	if (units < secondLevelCount) {
+	    fl = 0;
+	    sl = units;
+	} else {
+	    uint32_t top = log2(units);
+	    fl = top - secondLevelLog2 + 1;
+	    sl = (units >> (top - secondLevelLog2)) ^ secondLevelCount;
+	}
+    }
+
+    uint32_t findFree(uint32_t fl, uint32_t sl) const {
+	if (fl >= firstLevelCount) {
+	    return invalid;
+	}
+
+	uint32_t slMap = sl < secondLevelCount ? secondLevelBitmap[fl] & (~0u << sl) : 0;
+	if (slMap == 0) {
+	    uint64_t flMap = fl + 1 < 64 ? firstLevelBitmap & (~0ull << (fl + 1)) : 0;
+	    if (flMap == 0) {
+		return invalid;
+	    }
+
+	    fl = __builtin_ctzll(flMap);
+	    slMap = secondLevelBitmap[fl];
+	}
+
+	sl = __builtin_ctz(slMap);
+	return freeHeads[fl][sl];
+    }
+
+    uint32_t newNode(const Block& block) {
+	if (!unusedNodes.empty()) {
+	    uint32_t node = unusedNodes.back();
+	    unusedNodes.pop_back();
+	    blocks[node] = block;
+	    return node;
+	}
+
+	blocks.push_back(block);
+	return blocks.size() - 1;
+    }
+
+    void insertFree(uint32_t node) {
+	uint32_t fl, sl;
+	mapping(blocks[node].size, fl, sl);
+
+	Block& block = blocks[node];
+	block.free = true;
+	block.prevFree = invalid;
+	block.nextFree = freeHeads[fl][sl];
+
+	if (block.nextFree != invalid) {
+	    blocks[block.nextFree].prevFree = node;
+	}
+
+	freeHeads[fl][sl] = node;
+	firstLevelBitmap |= 1ull << fl;
+	secondLevelBitmap[fl] |= 1u << sl;
+    }
+
+    void removeFree(uint32_t node) {
+	uint32_t fl, sl;
+	mapping(blocks[node].size, fl, sl);
+
+	Block& block = blocks[node];
+	if (block.prevFree != invalid) {
+	    blocks[block.prevFree].nextFree = block.nextFree;
+	} else {
+	    freeHeads[fl][sl] = block.nextFree;
+	}
+	if (block.nextFree != invalid) {
+	    blocks[block.nextFree].prevFree = block.prevFree;
+	}
+
+	if (freeHeads[fl][sl] == invalid) {
+	    secondLevelBitmap[fl] &= ~(1u << sl);
+	    if (secondLevelBitmap[fl] == 0) {
+		firstLevelBitmap &= ~(1ull << fl);
+	    }
+	}
+    }
+
+    // Merges the physically following block into node and recycles its node
+    void absorb(uint32_t node, uint32_t next) {
+	blocks[node].size += blocks[next].size;
+	blocks[node].nextPhysical = blocks[next].nextPhysical;
+
+	if (blocks[node].nextPhysical != invalid) {
+	    blocks[blocks[node].nextPhysical].prevPhysical = node;
+	}
+
+	unusedNodes.push_back(next);
+    }
+};
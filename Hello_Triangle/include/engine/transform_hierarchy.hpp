@@ -0,0 +1,308 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <engine/worker_pool.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Parent/child transforms: a node's world matrix is its parent's world
+// matrix times its own local matrix. Changing a local matrix or a parent
+// only flags the node; update() then recomputes the flagged nodes and their
+// subtrees and leaves every other world matrix as it was.
+//
+// Nodes are stored breadth first, all roots, then all their children and
+// so on, each level contiguous. A parent always sits in an earlier level
+// than its children, so update() walks the levels in order and splits each
+// one across a worker pool without locking. The layout is rebuilt on the
+// first update() after nodes were added, removed or reparented.
+//
+// Node ids are chosen by the caller (the scene uses entity indices) and may
+// be reused once removed.
+class TransformHierarchy {
+public:
+    static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+    // Memory per node, for the benchmarks
+    static constexpr size_t bytesPerNode = 2 * sizeof(glm::mat4) + 4 * sizeof(uint32_t) + 2 * sizeof(uint8_t);
+
+private:
+    static constexpr size_t nodesPerTask = 4096;
+
+    // Indexed by node id
+    std::vector<uint32_t> parents;      // parent node id, or none for a root
+    std::vector<uint32_t> slots;        // position in the layout, or none if absent
+
+    // Indexed by slot. The flags are bytes rather than a vector<bool> so
+    // tasks can write neighbouring ones concurrently.
+    std::vector<uint32_t> nodes;        // node id, or none for a removed node
+    std::vector<uint32_t> parentSlots;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint8_t> dirty;         // local matrix or parent changed since the last update
+    std::vector<uint8_t> recomputed;    // world matrix recomputed by the last update
+
+    std::vector<size_t> levels;         // first slot of each level, then the slot count
+    size_t count;
+    bool stale;
+
+    // Orders the live nodes breadth first, roots in id order and children
+    // in id order under their parent, dropping removed ones
+    void relayout() {
+	// Children grouped by parent (counting sort)
+	std::vector<uint32_t> childStart(parents.size() + 1, 0);
+	for (uint32_t node = 0; node < parents.size(); ++node) {
+	    if (slots[node] != none && parents[node] != none) {
+		++childStart[parents[node] + 1];
+	    }
+	}
+	for (size_t i = 1; i < childStart.size(); ++i) {
+	    childStart[i] += childStart[i - 1];
+	}
+
+	std::vector<uint32_t> children(childStart.back());
+	std::vector<uint32_t> cursor(childStart.begin(), childStart.end() - 1);
+	for (uint32_t node = 0; node < parents.size(); ++node) {
+	    if (slots[node] != none && parents[node] != none) {
+		children[cursor[parents[node]]++] = node;
+	    }
+	}
+
+	std::vector<uint32_t> order;
+	order.reserve(count);
+	for (uint32_t node = 0; node < parents.size(); ++node) {
+	    if (slots[node] != none && parents[node] == none) {
+		order.push_back(node);
+	    }
+	}
+
+	levels.clear();
+	size_t begin = 0;
+	while (begin < order.size()) {
+	    levels.push_back(begin);
+	    size_t end = order.size();
+	    for (size_t i = begin; i < end; ++i) {
+		uint32_t node = order[i];
+		order.insert(order.end(), children.begin() + childStart[node], children.begin() + childStart[node + 1]);
+	    }
+	    begin = end;
+	}
+	levels.push_back(order.size());
+
+	std::vector<uint32_t> newParentSlots(order.size());
+	std::vector<glm::mat4> newLocals(order.size());
+	std::vector<glm::mat4> newWorlds(order.size());
+	std::vector<uint8_t> newDirty(order.size());
+
+	// Parents are placed before their children, so their new slot is
+	// already known
+	for (uint32_t slot = 0; slot < order.size(); ++slot) {
+	    uint32_t node = order[slot];
+	    uint32_t old = slots[node];
+
+	    newLocals[slot] = locals[old];
+	    newWorlds[slot] = worlds[old];
+	    newDirty[slot] = dirty[old];
+	    slots[node] = slot;
+	    newParentSlots[slot] = parents[node] == none ? none : slots[parents[node]];
+	}
+
+	nodes = std::move(order);
+	parentSlots = std::move(newParentSlots);
+	locals = std::move(newLocals);
+	worlds = std::move(newWorlds);
+	dirty = std::move(newDirty);
+	recomputed.assign(nodes.size(), 0);
+	stale = false;
+    }
+
+    void updateSlots(size_t begin, size_t end) {
+	for (size_t slot = begin; slot < end; ++slot) {
+	    uint32_t parent = parentSlots[slot];
+	    bool recompute = dirty[slot] || (parent != none && recomputed[parent]);
+
+	    recomputed[slot] = recompute;
+	    if (recompute) {
+		// Roots copy their local matrix as is, so a flat scene poses
+		// exactly as it did without a hierarchy
+		worlds[slot] = parent == none ? locals[slot] : worlds[parent] * locals[slot];
+		dirty[slot] = 0;
+	    }
+	}
+    }
+
+public:
+    TransformHierarchy()
+        : parents{},
+          slots{},
+          nodes{},
+          parentSlots{},
+          locals{},
+          worlds{},
+          dirty{},
+          recomputed{},
+          levels{},
+          count{0},
+          stale{false}
+    {}
+
+    bool contains(uint32_t node) const {
+	return node < slots.size() && slots[node] != none;
+    }
+
+    // Adds a node under parent, or as a root. Returns false if the node
+    // exists already or the parent does not.
+    bool add(uint32_t node, const glm::mat4& local, uint32_t parent = none) {
+	if (contains(node) || (parent != none && !contains(parent))) {
+	    std::cerr << "ERROR::HIERARCHY::INVALID_NODE " << node << std::endl;
+	    return false;
+	}
+
+	if (node >= slots.size()) {
+	    parents.resize(node + 1, none);
+	    slots.resize(node + 1, none);
+	}
+	parents[node] = parent;
+	slots[node] = (uint32_t)nodes.size();
+
+	nodes.push_back(node);
+	parentSlots.push_back(none);
+	locals.push_back(local);
+	worlds.push_back(local);
+	dirty.push_back(1);
+	recomputed.push_back(0);
+
+	++count;
+	stale = true;
+	return true;
+    }
+
+    // Removes a node. Its children become roots, keeping their local
+    // matrices. Linear in the number of node ids.
+    void remove(uint32_t node) {
+	if (!contains(node)) {
+	    return;
+	}
+
+	for (uint32_t child = 0; child < parents.size(); ++child) {
+	    if (parents[child] == node) {
+		parents[child] = none;
+		dirty[slots[child]] = 1;
+	    }
+	}
+
+	nodes[slots[node]] = none;
+	slots[node] = none;
+	parents[node] = none;
+
+	--count;
+	stale = true;
+    }
+
+    // Moves a node and its subtree under parent, or to the roots. Returns
+    // false if either node is missing or parent lies in node's subtree.
+    bool setParent(uint32_t node, uint32_t parent) {
+	if (!contains(node) || (parent != none && !contains(parent))) {
+	    std::cerr << "ERROR::HIERARCHY::INVALID_NODE " << node << std::endl;
+	    return false;
+	}
+	for (uint32_t ancestor = parent; ancestor != none; ancestor = parents[ancestor]) {
+	    if (ancestor == node) {
+		std::cerr << "ERROR::HIERARCHY::CYCLE " << node << std::endl;
+		return false;
+	    }
+	}
+
+	if (parents[node] != parent) {
+	    parents[node] = parent;
+	    dirty[slots[node]] = 1;
+	    stale = true;
+	}
+	return true;
+    }
+
+    void setLocal(uint32_t node, const glm::mat4& local) {
+	uint32_t slot = slots[node];
+	locals[slot] = local;
+	dirty[slot] = 1;
+    }
+
+    uint32_t parent(uint32_t node) const {
+	return parents[node];
+    }
+
+    const glm::mat4& local(uint32_t node) const {
+	return locals[slots[node]];
+    }
+
+    // As of the last update()
+    const glm::mat4& world(uint32_t node) const {
+	return worlds[slots[node]];
+    }
+
+    // Whether the last update() recomputed the node's world matrix
+    bool changed(uint32_t node) const {
+	return recomputed[slots[node]] != 0;
+    }
+
+    size_t size() const {
+	return count;
+    }
+
+    // One past the largest node id ever added
+    size_t idLimit() const {
+	return parents.size();
+    }
+
+    // Depth of the deepest node plus one, as of the last update()
+    size_t levelCount() const {
+	return levels.empty() ? 0 : levels.size() - 1;
+    }
+
+    // Recomputes the world matrices of dirty nodes and everything below
+    // them, level by level, with each level split across workers if given
+    void update(WorkerPool* workers = nullptr) {
+	if (stale) {
+	    relayout();
+	}
+
+	for (size_t level = 0; level + 1 < levels.size(); ++level) {
+	    size_t begin = levels[level];
+	    size_t end = levels[level + 1];
+	    size_t taskCount = (end - begin + nodesPerTask - 1) / nodesPerTask;
+
+	    auto task = [&](size_t t) {
+		updateSlots(begin + t * nodesPerTask, std::min(end, begin + (t + 1) * nodesPerTask));
+	    };
+
+	    if (workers != nullptr) {
+		workers->run(taskCount, task);
+	    } else {
+		for (size_t t = 0; t < taskCount; ++t) {
+		    task(t);
+		}
+	    }
+	}
+    }
+
+    // World matrices for other local matrices, both indexed by node id,
+    // such as the poses at some other time. The stored state is left
+    // alone apart from the layout.
+    void compose(const std::vector<glm::mat4>& nodeLocals, std::vector<glm::mat4>& nodeWorlds) {
+	if (stale) {
+	    relayout();
+	}
+
+	nodeWorlds.resize(parents.size());
+	for (uint32_t node : nodes) {
+	    uint32_t parent = parents[node];
+	    nodeWorlds[node] = parent == none ? nodeLocals[node] : nodeWorlds[parent] * nodeLocals[node];
+	}
+    }
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <engine/gl_handle.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Uniform block bindings shared by every program
+constexpr GLuint frameBlockBinding = 0;
+constexpr GLuint objectBlockBinding = 1;
+
+// Mirrors the std140 "Frame" block: constants bound once per frame
+struct FrameConstants {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    float time;
+    float padding[3];
+};
+
+// Mirrors the std140 "Object" block: constants bound once per draw
+struct ObjectConstants {
+    glm::mat4 model;
+};
+
+static_assert(sizeof(FrameConstants) == 208, "FrameConstants must match the std140 layout");
+static_assert(sizeof(ObjectConstants) == 64, "ObjectConstants must match the std140 layout");
+
+// Persistently mapped ring of uniform data, one segment per frame in flight.
+// Every frame writes into the next segment and binds ranges of it; a fence
+// per segment keeps the CPU from overwriting data the GPU has not read yet.
+// Offsets are handed out on the GL thread, but the mapped memory behind them
+// can be filled from any thread before the frame is submitted.
+class UniformStream {
+private:
+    static constexpr size_t segments = 3;
+    static constexpr GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    Buffer buffer;
+    uint8_t* mapped;
+    size_t segmentSize;
+    size_t alignment;
+    std::array<Fence, segments> fences;
+    size_t segment;
+    size_t used;
+
+    // Waits for every segment, then replaces the storage with a larger one
+    void grow(size_t bytes) {
+	for (auto& fence : fences) {
+	    if (fence) {
+		fence.wait();
+		fence.reset();
+	    }
+	}
+
+	if (buffer) {
+	    glUnmapNamedBuffer(buffer.get());
+	}
+
+	segmentSize = std::max(bytes, segmentSize * 2);
+	segmentSize = (segmentSize + alignment - 1) / alignment * alignment;
+
+	buffer = Buffer::create();
+	glNamedBufferStorage(buffer.get(), segments * segmentSize, nullptr, mapFlags);
+	mapped = static_cast<uint8_t*>(glMapNamedBufferRange(buffer.get(), 0, segments * segmentSize, mapFlags));
+    }
+
+public:
+    explicit UniformStream(size_t initialSegmentSize = 64 << 10)
+        : buffer{},
+          mapped{nullptr},
+          segmentSize{0},
+          alignment{0},
+          fences{},
+          segment{0},
+          used{0}
+    {
+        GLint offsetAlignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        alignment = std::max<size_t>(offsetAlignment, 16);
+
+        grow(initialSegmentSize);
+    }
+
+    UniformStream(const UniformStream&) = delete;
+    UniformStream& operator=(const UniformStream&) = delete;
+
+    ~UniformStream() {
+	if (buffer) {
+	    glUnmapNamedBuffer(buffer.get());
+	}
+    }
+
+    // Distance between consecutive blocks bound with glBindBufferRange
+    size_t stride(size_t blockSize) const {
+	return (blockSize + alignment - 1) / alignment * alignment;
+    }
+
+    // Moves to the next segment, making sure it holds at least bytes.
+    // Blocks only if the GPU is still reading the segment from three frames ago.
+    void beginFrame(size_t bytes) {
+	segment = (segment + 1) % segments;
+	used = 0;
+
+	if (bytes > segmentSize) {
+	    grow(bytes);
+	} else if (fences[segment]) {
+	    fences[segment].wait();
+	    fences[segment].reset();
+	}
+    }
+
+    // Called after the last draw reading this frame's segment
+    void endFrame() {
+	fences[segment] = Fence::insert();
+    }
+
+    // Reserves bytes in the current segment, returning the buffer offset or
+    // -1 if the segment is full
+    GLintptr allocate(size_t bytes) {
+	size_t size = stride(bytes);
+	if (used + size > segmentSize) {
+	    return -1;
+	}
+
+	GLintptr offset = segment * segmentSize + used;
+	used += size;
+	return offset;
+    }
+
+    void* pointer(GLintptr offset) const {
+	return mapped + offset;
+    }
+
+    GLuint get() const {
+	return buffer.get();
+    }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENGINE_VERTEX_TRANSFORM_X86 1
+#include <immintrin.h>
+#endif
+
+// Batched point transform for the CPU paths (software rasterizer, picking,
+// bounds): out = m * vec4(p, 1) for every position, in structure-of-arrays
+// blocks of 8 (AVX2) or 16 (AVX-512) points. The kernel is picked at run
+// time from what the CPU supports, so one binary runs everywhere.
+//
+// Every kernel rounds exactly like glm's mat4 * vec4,
+// (m[0] * x + m[1] * y) + (m[2] * z + m[3] * w), with separate multiplies
+// and adds and w = 1, so their results are bitwise identical to glm's.
+// That needs floating point contraction off: GCC would otherwise fuse the
+// multiplies and adds into FMAs, in the AVX-512 kernel whose target
+// includes FMA and on the glm side when built for such a CPU. The kernels
+// below turn it off themselves; the build passes -ffp-contract=off so glm
+// is compiled the same way. tests/vertex_transform_test.cpp checks it.
+
+// Positions split into one array per coordinate, padded with zeros to
+// whole blocks so no kernel needs a tail loop
+struct PositionBlocks {
+    static constexpr size_t blockSize = 16;
+
+    size_t count = 0;
+    std::vector<float> x, y, z;
+
+    void assign(const std::vector<glm::vec3>& positions) {
+	count = positions.size();
+	size_t padded = (count + blockSize - 1) / blockSize * blockSize;
+	x.assign(padded, 0.0f);
+	y.assign(padded, 0.0f);
+	z.assign(padded, 0.0f);
+
+	for (size_t i = 0; i < count; ++i) {
+	    x[i] = positions[i].x;
+	    y[i] = positions[i].y;
+	    z[i] = positions[i].z;
+	}
+    }
+
+    size_t padded() const {
+	return x.size();
+    }
+};
+
+// Homogeneous results, laid out like PositionBlocks
+struct TransformedPositions {
+    size_t count = 0;
+    std::vector<float> x, y, z, w;
+
+    glm::vec4 operator[](size_t i) const {
+	return glm::vec4(x[i], y[i], z[i], w[i]);
+    }
+};
+
+enum class VertexKernel {
+    Scalar,
+    Avx2,
+    Avx512
+};
+
+inline const char* vertexKernelName(VertexKernel kernel) {
+    switch (kernel) {
+	case VertexKernel::Avx2:
+	    return "avx2";
+	case VertexKernel::Avx512:
+	    return "avx512";
+	default:
+	    return "scalar";
+    }
+}
+
+inline bool vertexKernelSupported(VertexKernel kernel) {
+#if defined(ENGINE_VERTEX_TRANSFORM_X86)
+    switch (kernel) {
+	case VertexKernel::Avx2:
+	    return __builtin_cpu_supports("avx2");
+	case VertexKernel::Avx512:
+	    return __builtin_cpu_supports("avx512f");
+	default:
+	    return true;
+    }
+#else
+    return kernel == VertexKernel::Scalar;
+#endif
+}
+
+// Widest kernel this CPU runs, detected once
+inline VertexKernel bestVertexKernel() {
+    static const VertexKernel best = [] {
+	if (vertexKernelSupported(VertexKernel::Avx512)) {
+	    return VertexKernel::Avx512;
+	}
+	if (vertexKernelSupported(VertexKernel::Avx2)) {
+	    return VertexKernel::Avx2;
+	}
+	return VertexKernel::Scalar;
+    }();
+    return best;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+inline void transformPositionsScalar(const glm::mat4& m, const PositionBlocks& in, TransformedPositions& out) {
+    float* rows[4] = { out.x.data(), out.y.data(), out.z.data(), out.w.data() };
+
+    for (size_t i = 0; i < in.count; ++i) {
+	for (int r = 0; r < 4; ++r) {
+	    rows[r][i] = (m[0][r] * in.x[i] + m[1][r] * in.y[i]) + (m[2][r] * in.z[i] + m[3][r]);
+	}
+    }
+}
+
+#if defined(ENGINE_VERTEX_TRANSFORM_X86)
+__attribute__((target("avx2")))
+inline void transformPositionsAvx2(const glm::mat4& m, const PositionBlocks& in, TransformedPositions& out) {
+    float* rows[4] = { out.x.data(), out.y.data(), out.z.data(), out.w.data() };
+
+    __m256 c[4][4];
+    for (int col = 0; col < 4; ++col) {
+	for (int r = 0; r < 4; ++r) {
+	    c[col][r] = _mm256_set1_ps(m[col][r]);
+	}
+    }
+
+    for (size_t i = 0; i < in.padded(); i += 8) {
+	__m256 x = _mm256_loadu_ps(&in.x[i]);
+	__m256 y = _mm256_loadu_ps(&in.y[i]);
+	__m256 z = _mm256_loadu_ps(&in.z[i]);
+
+	for (int r = 0; r < 4; ++r) {
+	    __m256 xy = _mm256_add_ps(_mm256_mul_ps(c[0][r], x), _mm256_mul_ps(c[1][r], y));
+	    __m256 zw = _mm256_add_ps(_mm256_mul_ps(c[2][r], z), c[3][r]);
+	    _mm256_storeu_ps(rows[r] + i, _mm256_add_ps(xy, zw));
+	}
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void transformPositionsAvx512(const glm::mat4& m, const PositionBlocks& in, TransformedPositions& out) {
+    float* rows[4] = { out.x.data(), out.y.data(), out.z.data(), out.w.data() };
+
+    __m512 c[4][4];
+    for (int col = 0; col < 4; ++col) {
+	for (int r = 0; r < 4; ++r) {
+	    c[col][r] = _mm512_set1_ps(m[col][r]);
+	}
+    }
+
+    for (size_t i = 0; i < in.padded(); i += 16) {
+	__m512 x = _mm512_loadu_ps(&in.x[i]);
+	__m512 y = _mm512_loadu_ps(&in.y[i]);
+	__m512 z = _mm512_loadu_ps(&in.z[i]);
+
+	for (int r = 0; r < 4; ++r) {
+	    __m512 xy = _mm512_add_ps(_mm512_mul_ps(c[0][r], x), _mm512_mul_ps(c[1][r], y));
+	    __m512 zw = _mm512_add_ps(_mm512_mul_ps(c[2][r], z), c[3][r]);
+	    _mm512_storeu_ps(rows[r] + i, _mm512_add_ps(xy, zw));
+	}
+    }
+}
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+// Transforms every position of in with m. The output grows to in's padded
+// size; entries past in.count are left unspecified.
+inline void transformPositions(const glm::mat4& m, const PositionBlocks& in, TransformedPositions& out, VertexKernel kernel = bestVertexKernel()) {
+    out.count = in.count;
+    if (out.x.size() < in.padded()) {
+	out.x.resize(in.padded());
+	out.y.resize(in.padded());
+	out.z.resize(in.padded());
+	out.w.resize(in.padded());
+    }
+
+    switch (kernel) {
+#if defined(ENGINE_VERTEX_TRANSFORM_X86)
+	case VertexKernel::Avx512:
+	    transformPositionsAvx512(m, in, out);
+	    return;
+	case VertexKernel::Avx2:
+	    transformPositionsAvx2(m, in, out);
+	    return;
+#endif
+	default:
+	    transformPositionsScalar(m, in, out);
+	    return;
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run the tasks of one parallel loop at a time.
+// The calling thread takes part, so a pool of N workers runs N + 1 tasks
+// concurrently, and a loop with a single task never wakes anyone.
+class WorkerPool {
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    std::function<void(size_t)> task;
+    size_t taskCount;
+    size_t nextTask;
+    size_t finished;
+    uint64_t generation;
+    bool stopping;
+
+public:
+    explicit WorkerPool(size_t workers)
+        : threads{},
+          taskCount{0},
+          nextTask{0},
+          finished{0},
+          generation{0},
+          stopping{false}
+    {
+        for (size_t i = 0; i < workers; ++i) {
+            threads.emplace_back(&WorkerPool::work, this);
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+	{
+	    std::lock_guard<std::mutex> lock(mutex);
+	    stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& thread : threads) {
+	    thread.join();
+	}
+    }
+
+    size_t size() const {
+	return threads.size();
+    }
+
+    // Calls fn(i) for every i in [0, count) and returns when all are done
+    void run(size_t count, const std::function<void(size_t)>& fn) {
+	if (count == 0) {
+	    return;
+	}
+	if (count == 1 || threads.empty()) {
+	    for (size_t i = 0; i < count; ++i) {
+		fn(i);
+	    }
+	    return;
+	}
+
+	{
+	    std::lock_guard<std::mutex> lock(mutex);
+	    task = fn;
+	    taskCount = count;
+	    nextTask = 0;
+	    finished = 0;
+	    ++generation;
+	}
+	wake.notify_all();
+
+	drain();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return finished == taskCount; });
+	task = nullptr;
+    }
+
+private:
+    // Claims and runs tasks of the current loop until none are left
+    void drain() {
+	while (true) {
+	    size_t i;
+	    {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (nextTask >= taskCount) {
+		    return;
+		}
+		i = nextTask++;
+	    }
+
+	    task(i);
+
+	    bool last;
+	    {
+		std::lock_guard<std::mutex> lock(mutex);
+		last = ++finished == taskCount;
+	    }
+	    if (last) {
+		done.notify_all();
+	    }
+	}
+    }
+
+    void work() {
+	uint64_t seen = 0;
+
+	while (true) {
+	    {
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+		if (stopping) {
+		    return;
+		}
+		seen = generation;
+	    }
+
+	    drain();
+	}
+    }
+};
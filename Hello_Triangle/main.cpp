@@ -4,13 +4,47 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <engine/material.hpp>
+#include <engine/mesh.hpp>
+#include <engine/mesh_optimizer.hpp>
+#include <engine/scene_file.hpp>
+#include <engine/mesh_loader.hpp>
+#include <engine/shader.hpp>
+#include <engine/framebuffer.hpp>
+#include <engine/instance_buffer.hpp>
+#include <engine/oit.hpp>
+#include <engine/frame_pipeline.hpp>
+#include <engine/frame_pacing.hpp>
+#include <engine/command_buffer.hpp>
+#include <engine/worker_pool.hpp>
+#include <engine/uniform_buffer.hpp>
+#include <engine/camera.hpp>
+#include <engine/scene_generator.hpp>
+#include <engine/scene_shaders.hpp>
+#include <engine/pyramid.hpp>
+#include <engine/scene.hpp>
+#include <engine/image_compare.hpp>
+#include <engine/readback.hpp>
+#include <engine/frame_stream.hpp>
+#include <engine/software_rasterizer.hpp>
+
 #include <iostream>
 #include <vector>
 #include <array>
+#include <csignal>
+#include <deque>
 #include <chrono>
 #include <utility>
-
-GLuint shaderProgram;
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
 
 // Callback function to adjust the viewport when the window is resized
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -19,314 +53,1227 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
         glViewport(0, 0, width, height);
 }  
 
-// Vertex Shader and Fragment Shader (same as before)
-const char* vertexShaderSource = R"(
-#version 460 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
-uniform mat4 trans;
-out vec3 vertexColor;
-void main()
+// GLFW window and OpenGL setup (same as before)
+void init_gl_window() {
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+}
+
+// WASD flies, Q/E sink and rise, the arrow keys look around and shift
+// speeds everything up tenfold. P switches between perspective and
+// orthographic projection.
+void processInput(GLFWwindow *window, Camera& camera, float delta_time) {
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+
+    auto pressed = [window](int key) { return glfwGetKey(window, key) == GLFW_PRESS; };
+
+    float speed = (pressed(GLFW_KEY_LEFT_SHIFT) ? 10.0f : 1.0f) * delta_time;
+    glm::vec3 move(
+	(pressed(GLFW_KEY_D) ? 1.0f : 0.0f) - (pressed(GLFW_KEY_A) ? 1.0f : 0.0f),
+	(pressed(GLFW_KEY_E) ? 1.0f : 0.0f) - (pressed(GLFW_KEY_Q) ? 1.0f : 0.0f),
+	(pressed(GLFW_KEY_W) ? 1.0f : 0.0f) - (pressed(GLFW_KEY_S) ? 1.0f : 0.0f)
+    );
+    camera.move(move * speed);
+
+    float turn = 90.0f * speed;
+    camera.turn(
+	((pressed(GLFW_KEY_RIGHT) ? 1.0f : 0.0f) - (pressed(GLFW_KEY_LEFT) ? 1.0f : 0.0f)) * turn,
+	((pressed(GLFW_KEY_UP) ? 1.0f : 0.0f) - (pressed(GLFW_KEY_DOWN) ? 1.0f : 0.0f)) * turn
+    );
+
+    // Toggle on the press, not while the key is held
+    static bool projectionKeyHeld = false;
+    if (pressed(GLFW_KEY_P) && !projectionKeyHeld) {
+	camera.setProjection(
+	    camera.getProjection() == Projection::Perspective ? Projection::Orthographic : Projection::Perspective
+	);
+    }
+    projectionKeyHeld = pressed(GLFW_KEY_P);
+}
+
+// Binds a material only when it differs from the one currently bound
+void bindMaterial(const Material* material, const Material*& bound) {
+    if (material != bound) {
+	material->bind();
+	bound = material;
+    }
+}
+
+// Translucent pyramids sharing a material and mesh, drawn with a single instanced call
+struct TranslucentBatch {
+    const Material* material;
+    const Mesh* mesh;
+    std::vector<uint32_t> rows;
+};
+
+// Per-task state of the parallel recording pass, kept across frames so the
+// command memory is reused
+struct RecordTask {
+    CommandBuffer commands;
+    std::vector<uint32_t> translucent;
+};
+
+// Objects recorded by one task; large enough that the per-task setup and
+// the material rebind at the start of each buffer are noise
+constexpr size_t objectsPerTask = 4096;
+
+// GL resources and scratch state renderScene reuses from frame to frame
+struct Renderer {
+    SceneFramebuffer sceneTarget;
+    WeightedBlendedOIT oit;
+    InstanceBuffer instances;
+    TransformBuffer transforms;
+    UniformStream uniforms;
+    WorkerPool workers;
+    std::vector<RecordTask> recordTasks;
+    std::vector<TranslucentBatch> batches;
+
+    explicit Renderer(size_t recordThreads)
+        : sceneTarget{},
+          oit{},
+          instances{},
+          transforms{},
+          uniforms{},
+          workers{recordThreads},
+          recordTasks{},
+          batches{}
+    {}
+
+    void resize(int width, int height) {
+	if (sceneTarget.resize(width, height)) {
+	    oit.resize(width, height, sceneTarget.getDepthTexture());
+	}
+    }
+};
+
+// Records the opaque draws of scene rows [begin, end) and collects the
+// translucent ones for batching on the GL thread
+void recordObjects(
+    const Scene& scene,
+    const std::vector<glm::mat4>& transforms,
+    const Frustum& frustum,
+    size_t begin,
+    size_t end,
+    RecordTask& task)
 {
-    gl_Position = trans * vec4(aPos, 1.0f);
-    vertexColor = aColor;
-})";
-
-const char* fragmentShaderSource = R"(
-#version 460 core
-in vec3 vertexColor;
-out vec4 FragColor;
-void main()
+    const Material* bound = nullptr;
+
+    task.commands.reset();
+    task.translucent.clear();
+
+    const std::vector<Renderable>& renderables = scene.column<Renderable>();
+    const std::vector<Bounds>& bounds = scene.column<Bounds>();
+
+    for (size_t i = begin; i < end; ++i) {
+	const Material* material = renderables[i].material;
+
+	// Off screen or still streaming in
+	if (!renderables[i].mesh->isReady() || !isVisible(frustum, transforms[i], bounds[i])) {
+	    continue;
+	}
+
+	if (material->isTranslucent()) {
+	    task.translucent.push_back((uint32_t)i);
+	    continue;
+	}
+
+	if (material != bound) {
+	    task.commands.bindProgram(material->program);
+	    task.commands.setUniform(material->uniAlpha, material->alpha);
+	    bound = material;
+	}
+
+	recordObject(task.commands, renderables[i], (uint32_t)i);
+    }
+}
+
+// Draws opaque pyramids with blending disabled so the color buffer is only
+// written, never read back. Translucent pyramids are then gathered into
+// per-material batches and resolved with weighted blended OIT, so they can
+// be drawn in any order without sorting.
+//
+// The opaque traversal is split across the worker pool, each task recording
+// its own command buffer; the GL thread only replays them in task order, so
+// the draw order is the same as a serial traversal.
+//
+// Per-frame constants are bound once. Model matrices live in the transform
+// buffer across frames and only the given changed rows of transforms are
+// sent again, or every row if there is no such list. Opaque draws find
+// their matrix by base instance and bind nothing per object; translucent
+// batches upload just their row indices.
+void renderScene(
+    const Scene& scene,
+    const std::vector<glm::mat4>& transforms,
+    const std::vector<uint32_t>* changedRows,
+    const FrameConstants& frame,
+    Renderer& renderer)
 {
-    FragColor = vec4(vertexColor, 1.0f);
-})";
+    auto& tasks = renderer.recordTasks;
+    auto& batches = renderer.batches;
+    auto& uniforms = renderer.uniforms;
+    const Material* bound = nullptr;
+    Frustum frustum(frame.viewProjection);
+    bool hasTranslucent = false;
 
-// Pyramid class definition
-class Pyramid {
-private:
-    GLuint VBO, VAO, EBO;
-    glm::mat4 rotationMatrixX, rotationMatrixY, rotationMatrixZ, translationMatrix, scalingMatrix;
-    GLuint uniTrans;
-
-    static constexpr const std::array<glm::vec3, 12> vertices = {{
-        {0.0f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f},         // top-center           0
-        {0.5f, -0.5f, 0.5f}, {1.0f, 0.0f, 0.0f},        // back-right           1
-        {-0.5f, -0.5f, 0.5f}, {0.0f, 1.0f, 0.0f},       // back-left            2
-        {0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, 1.0f},       // front-right          3
-        {-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 1.0f},      // front-left           4
-        {0.0f, -0.5f, 0.0f}, {0.0f, 0.0f, 0.0f}        	// bottom-center        5
-    }};
-
-    static constexpr const std::array<unsigned int, 24> indices = {{
-        0,1,2, // face 1
-        0,3,4, // face 2
-        0,1,3, // face 3
-        0,2,4, // face 4
-
-	// Bottom
-        5,1,2,
-        5,1,3,
-        5,3,4,
-        5,2,4
-    }};
+    const std::vector<Renderable>& renderables = scene.column<Renderable>();
 
-public:
+    uniforms.beginFrame(uniforms.stride(sizeof(FrameConstants)));
 
-    Pyramid(GLuint shaderProgram)
-        : VBO{},
-          VAO{},
-          EBO{},
-          rotationMatrixX{1.0f},
-          rotationMatrixY{1.0f},
-          rotationMatrixZ{1.0f},
-          translationMatrix{1.0f},
-          scalingMatrix{1.0f},
-          uniTrans{}
-    {
-        // Initialize OpenGL resources
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+    GLintptr frameSlot = uniforms.allocate(sizeof(FrameConstants));
+    *static_cast<FrameConstants*>(uniforms.pointer(frameSlot)) = frame;
 
-        glBindVertexArray(VAO);
+    if (changedRows != nullptr) {
+	renderer.transforms.update(transforms, *changedRows);
+    } else {
+	renderer.transforms.upload(transforms);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+    size_t taskCount = (scene.size() + objectsPerTask - 1) / objectsPerTask;
+    if (tasks.size() < taskCount) {
+	tasks.resize(taskCount);
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    renderer.workers.run(taskCount, [&](size_t t) {
+	size_t begin = t * objectsPerTask;
+	size_t end = std::min(begin + objectsPerTask, scene.size());
+	recordObjects(scene, transforms, frustum, begin, end, tasks[t]);
+    });
 
-        // Vertex attribute pointers
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)0);
-        glEnableVertexAttribArray(0);
+    for (auto& batch : batches) {
+	batch.rows.clear();
+    }
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)(sizeof(glm::vec3)));
-        glEnableVertexAttribArray(1);
+    renderer.sceneTarget.bind();
+    glBindBufferRange(GL_UNIFORM_BUFFER, frameBlockBinding, uniforms.get(), frameSlot, sizeof(FrameConstants));
+    renderer.transforms.bind(0);
 
-        glUseProgram(shaderProgram);
-        uniTrans = glGetUniformLocation(shaderProgram, "trans");
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+
+    for (size_t t = 0; t < taskCount; ++t) {
+	replay(tasks[t].commands);
     }
+    glBindVertexArray(0);
 
+    // Replay leaves its own program bound
+    glUseProgram(0);
 
-    template <typename vec3 = glm::vec3>
-    void translate(vec3&& translation) {
-	translationMatrix = glm::translate(
-	    translationMatrix,
-	    std::forward<vec3>(translation)
-	);
+    for (size_t t = 0; t < taskCount; ++t) {
+	for (uint32_t i : tasks[t].translucent) {
+	    const Material* material = renderables[i].material;
+	    const Mesh* mesh = renderables[i].mesh;
+
+	    auto batch = std::find_if(batches.begin(), batches.end(),
+		[material, mesh](const TranslucentBatch& b) {
+		    return b.material == material && b.mesh == mesh;
+		}
+	    );
+
+	    if (batch == batches.end()) {
+		batches.push_back({ material, mesh, {} });
+		batch = batches.end() - 1;
+	    }
+
+	    batch->rows.push_back(i);
+	    hasTranslucent = true;
+	}
     }
 
-    template <typename vec3 = glm::vec3>
-    void scale(vec3&& translation) {
-	scalingMatrix = glm::scale(
-	    glm::mat4(1.0f),
-	    std::forward<vec3>(translation)
-	);
+    if (hasTranslucent) {
+	renderer.oit.begin();
+
+	for (auto& batch : batches) {
+	    if (batch.rows.empty()) {
+		continue;
+	    }
+
+	    renderer.instances.upload(batch.rows);
+	    renderer.instances.bind(1);
+
+	    bindMaterial(batch.material, bound);
+	    batch.mesh->drawInstanced(batch.rows.size());
+	}
+
+	renderer.sceneTarget.bind();
+	renderer.oit.composite();
     }
 
-    void rotateX(float angleDegrees) {
-	rotationMatrixX = glm::rotate(
-	    rotationMatrixX,
-	    glm::radians(angleDegrees),
-	    glm::vec3(1.0f, 0.0f, 0.0f)
-	);
+    renderer.sceneTarget.blitToDefault();
+    uniforms.endFrame();
+}
+
+
+// Writes the pyramid mesh and the current object transforms to a scene file.
+// Material index 0 is opaque, 1 translucent. Scene files have no hierarchy,
+// so objects are written with their world matrices and children no longer
+// follow their parents' motion once loaded.
+bool exportScene(const std::string& path, Scene& scene) {
+    const std::vector<Motion>& motions = scene.column<Motion>();
+    const std::vector<Renderable>& renderables = scene.column<Renderable>();
+    std::vector<SceneFileInstance> instances;
+
+    std::vector<glm::mat4> transforms;
+    modelMatricesAt(scene, 0.0f, transforms);
+
+    for (size_t i = 0; i < scene.size(); ++i) {
+	SceneFileInstance instance{};
+	const glm::mat4& transform = transforms[i];
+
+	std::memcpy(instance.transform, glm::value_ptr(transform), sizeof(instance.transform));
+	instance.mesh = 0;
+	instance.material = renderables[i].material->isTranslucent() ? 1 : 0;
+	instance.spin[0] = motions[i].spin.x;
+	instance.spin[1] = motions[i].spin.y;
+	instances.push_back(instance);
     }
 
-    void rotateY(float angleDegrees) {
-	rotationMatrixY = glm::rotate(
-	    rotationMatrixY,
-	    glm::radians(angleDegrees),
-	    glm::vec3(0.0f, 1.0f, 0.0f)
-	);
+    return writeSceneFile(path, { Pyramid::meshData() }, { Pyramid::vertexFormat }, instances);
+}
+
+// Queues every mesh for upload straight from the mapped file and adds one
+// object per instance. Meshes start out as placeholders and are filled in
+// by the loader thread while the scene is already rendering; the mapping
+// stays alive until the last mesh has been copied out of it.
+bool loadScene(
+    const std::string& path,
+    AsyncMeshLoader& loader,
+    GpuBufferArena& arena,
+    std::vector<Mesh>& meshes,
+    Scene& scene,
+    const Material* opaqueMaterial,
+    const Material* translucentMaterial)
+{
+    auto sceneFile = std::make_shared<MappedSceneFile>();
+    if (!sceneFile->open(path)) {
+	return false;
+    }
+
+    const SceneFileHeader& header = sceneFile->header();
+
+    // Renderables point into meshes, so it must not reallocate
+    meshes.clear();
+    meshes.reserve(header.meshCount);
+
+    for (uint32_t i = 0; i < header.meshCount; ++i) {
+	const SceneFileMesh& mesh = sceneFile->meshes()[i];
+
+	meshes.push_back(Mesh::reserve(arena, mesh.vertexSize, mesh.indexCount, mesh.indexType, mesh.vertexFormat()));
+
+	loader.submit({
+	    i, meshes[i].getVertexRange(), meshes[i].getIndexRange(),
+	    sceneFile->vertexData(mesh), sceneFile->indexData(mesh),
+	    mesh.indexType, mesh.indexCount, mesh.vertexSize / mesh.vertexFormat().stride(), sceneFile
+	});
     }
 
-    void rotateZ(float angleDegrees) {
-	rotationMatrixZ = glm::rotate(
-	    rotationMatrixZ,
-	    glm::radians(angleDegrees),
-	    glm::vec3(0.0f, 0.0f, 1.0f)
+    // Scene files only ever hold the pyramid mesh so far, so its bounds
+    // serve every instance
+    scene.reserve(scene.size() + header.instanceCount);
+    for (uint64_t i = 0; i < header.instanceCount; ++i) {
+	const SceneFileInstance& instance = sceneFile->instances()[i];
+
+	Transform transform;
+	transform.placement = glm::make_mat4(instance.transform);
+
+	scene.create(
+	    transform,
+	    Motion{ glm::vec2(instance.spin[0], instance.spin[1]) },
+	    Renderable{ &meshes[instance.mesh], instance.material == 1 ? translucentMaterial : opaqueMaterial },
+	    Bounds{ Pyramid::boundingRadius }
 	);
     }
 
-    void draw() {
-	glBindVertexArray(VAO);
+    return true;
+}
+
+// Advances the scene in fixed steps of 1/hz seconds, however often it is
+// called, so motion is the same at any frame rate. Each published packet
+// carries the state before and after its last step; the state for simulated
+// time t is computed one step early, at t - step, so the GL thread can
+// always interpolate up to the present instead of extrapolating past it.
+//
+// The rows each step changed are kept for a while. A packet coming back
+// for reuse only gets the rows changed since it was last filled, and it
+// lists for the GL thread the rows changed since the packet the reader
+// holds, so in a mostly static scene neither copies every row.
+class FixedStepSimulation {
+private:
+    // Time beyond this many steps per call (after a debugger break or a
+    // stall) is dropped rather than caught up, which would only fall
+    // further behind
+    static constexpr int64_t maxStepsPerCall = 8;
+
+    // Steps of changes kept at most. Older packets are copied in full.
+    static constexpr size_t maxHistory = 64;
+
+    struct StepChanges {
+	uint64_t step;
+	std::vector<uint32_t> rows;     // ascending
+    };
+
+    Scene& scene;
+    FramePipeline& pipeline;
+    WorkerPool workers;     // propagates each hierarchy level in parallel
+    std::chrono::steady_clock::duration step;
+    float stepSeconds;
+    std::chrono::steady_clock::time_point nextStep;
+    uint64_t steps;
+    FramePacket state;                  // after the last step
+    std::deque<StepChanges> history;    // consecutive steps up to the last
+    size_t historyRows;
+
+    // Collects the rows changed by the steps after the given one,
+    // ascending. Returns false if that is every row, or could be, or the
+    // history does not reach back far enough.
+    bool changedSince(uint64_t after, std::vector<uint32_t>& rows) const {
+	rows.clear();
+	if (after + history.size() < steps) {
+	    return false;
+	}
+
+	size_t merged = 0;
+	size_t total = 0;
+	for (const StepChanges& changes : history) {
+	    if (changes.step > after) {
+		rows.insert(rows.end(), changes.rows.begin(), changes.rows.end());
+		total += changes.rows.size();
+		++merged;
+	    }
+	}
+	if (total >= scene.size() && total > 0) {
+	    return false;
+	}
 
-        // Combine the rotations and send the transformation matrix to the shader
-        glm::mat4 final_transformation =
-		translationMatrix
-		* rotationMatrixX
-		* rotationMatrixY
-		* rotationMatrixZ
-		* scalingMatrix;
-	
-        glUniformMatrix4fv(uniTrans, 1, GL_FALSE, glm::value_ptr(final_transformation));
+	if (merged > 1) {
+	    std::sort(rows.begin(), rows.end());
+	    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+	}
+	return true;
+    }
 
-        // Draw the pyramid
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+public:
+    FixedStepSimulation(Scene& scene, FramePipeline& pipeline, float hz, size_t threads, std::chrono::steady_clock::time_point start)
+        : scene{scene},
+          pipeline{pipeline},
+          workers{threads},
+          step{std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / hz))},
+          stepSeconds{1.0f / hz},
+          nextStep{start},
+          steps{0},
+          state{},
+          history{},
+          historyRows{0}
+    {
+        simulateFrame(scene, 0.0f, state, &workers);
+    }
 
-	glBindVertexArray(0);
+    // When the next step is due
+    std::chrono::steady_clock::time_point due() const {
+	return nextStep;
     }
 
-    void cleanup() {
-        // Cleanup resources
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
+    // Runs the steps due by now and publishes the result. Returns false
+    // once the pipeline is stopped.
+    bool advance(std::chrono::steady_clock::time_point now) {
+	if (now < nextStep) {
+	    return true;
+	}
+
+	FramePacket* packet = pipeline.beginWrite();
+	if (packet == nullptr) {
+	    return false;
+	}
+
+	int64_t count = (now - nextStep) / step + 1;
+	if (count > maxStepsPerCall) {
+	    nextStep += (count - maxStepsPerCall) * step;
+	    count = maxStepsPerCall;
+	}
+
+	for (int64_t s = 0; s < count; ++s) {
+	    simulateFrame(scene, stepSeconds, state, &workers);
+	    nextStep += step;
+	    ++steps;
+
+	    history.push_back({ steps, state.moved });
+	    historyRows += state.moved.size();
+	}
+
+	// Bring the packet's copy of every row up to date
+	std::vector<uint32_t>& rows = packet->changed;
+	if (packet->transforms.size() != state.transforms.size() || !changedSince(packet->steps, rows)) {
+	    packet->transforms = state.transforms;
+	} else {
+	    for (uint32_t row : rows) {
+		packet->transforms[row] = state.transforms[row];
+	    }
+	}
+	packet->moved = state.moved;
+	packet->previousTransforms = state.previousTransforms;
+
+	// The reader's rows blended for the last step of its packet have to
+	// be replaced as well, hence the changes from that step on
+	uint64_t read;
+	packet->allChanged = !pipeline.lastRead(read) || !changedSince(read - 1, packet->changed);
+
+	// Full copies are cheaper than change lists longer than the scene
+	while (history.size() > maxHistory || historyRows > scene.size()) {
+	    historyRows -= history.front().rows.size();
+	    history.pop_front();
+	}
+
+	packet->steps = steps;
+	packet->time = steps * stepSeconds;
+	packet->step = stepSeconds;
+	packet->simulatedAt = nextStep - step;
+
+	pipeline.endWrite(packet);
+	return true;
     }
+};
+
+struct Options {
+    std::string scenePath;
+    std::string exportPath;
+    bool lockstep = false;
+    float simulationHz = 60.0f;
+    size_t simulationThreads = std::thread::hardware_concurrency() / 4;  // besides the simulation thread
+
+    // Presentation: vsync mode and an optional frame rate cap (0 for none)
+    SwapMode swapMode = SwapMode::On;
+    float frameLimit = 0.0f;
+    Projection projection = Projection::Perspective;
 
-    ~Pyramid() {}
+    // Golden image mode: render fixed simulated times offscreen and compare
+    // with (or with --update-golden, replace) the images in goldenDir
+    std::string goldenDir;
+    bool updateGolden = false;
+    std::vector<float> goldenTimes = { 0.0f, 0.25f, 0.5f, 1.0f, 2.0f };
+
+    // Render on the CPU without a window or GL context: the golden frames,
+    // or else softwareFrames frames of the animation at simulationHz,
+    // written to captureDir if given
+    bool software = false;
+    uint64_t softwareFrames = 240;
+
+    // Batch rendering: every frame is read back asynchronously and written
+    // to captureDir, with up to captureDepth frames in flight
+    std::string captureDir;
+    size_t captureDepth = 3;
+
+    // Streaming: raw frames of streamWidth x streamHeight go to streamPath
+    // ("-" for stdout), with at most streamDepth of them waiting for a slow
+    // reader. Rendering then waits for the reader, or with streamDrop the
+    // frame is dropped. streamFrames stops after that many frames, 0 runs
+    // until the reader or the window closes.
+    std::string streamPath;
+    StreamFormat streamFormat = StreamFormat::Yuv420;
+    size_t streamDepth = 4;
+    bool streamDrop = false;
+    int streamWidth = 1280;
+    int streamHeight = 720;
+    uint64_t streamFrames = 0;
+
+    // Procedural scene instead of the default grid
+    bool generate = false;
+    SceneGeneratorOptions generator;
+
+    // Threads recording draw commands besides the GL thread. The simulation
+    // and the loader each keep a core busy already.
+    size_t recordThreads = std::thread::hardware_concurrency() > 3 ? std::thread::hardware_concurrency() - 3 : 0;
 };
 
-// GLFW window and OpenGL setup (same as before)
-void init_gl_window() {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// Object counts --count accepts
+constexpr uint64_t minGeneratedCount = 10;
+constexpr uint64_t maxGeneratedCount = 10000000;
+
+// std::stoull wraps a negative number such as "-1" around to a huge value
+// instead of rejecting it
+uint64_t parseUnsigned(const std::string& text) {
+    if (text.find('-') != std::string::npos) {
+	throw std::invalid_argument(text);
+    }
+    return std::stoull(text);
 }
 
-void processInput(GLFWwindow *window) {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--scene file] [--export-scene file]"
+	<< " [--layout grid|scatter|clustered|overlap|orbits] [--count n] [--seed n] [--translucent-ratio r] [--static-ratio r]"
+	<< " [--golden dir [--update-golden] [--golden-times t0,t1,...]] [--software [--software-frames n]]"
+	<< " [--capture dir [--capture-depth n]]"
+	<< " [--stream file|- [--stream-format rgba|yuv420] [--stream-depth n] [--stream-drop] [--stream-size WxH] [--stream-frames n]]"
+	<< " [--lockstep] [--sim-hz n] [--sim-threads n] [--vsync off|on|adaptive] [--fps-limit n] [--ortho] [--record-threads n]" << std::endl;
 }
 
-int main() {
-    // Initialize and configure GLFW
-    init_gl_window();
+bool parseOptions(int argc, char** argv, Options& options) {
+    // std::stof and friends, and parseUnsigned(), throw on malformed,
+    // negative or out of range numbers
+    try {
+	for (int i = 1; i < argc; ++i) {
+	    std::string arg = argv[i];
 
-    // Create window
-    GLFWwindow *window = glfwCreateWindow(800, 600, "Multi-Colored Pyramids", NULL, NULL);
-    if (window == nullptr) {
-        std::cerr << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+	    if (arg == "--scene" && i + 1 < argc) {
+		options.scenePath = argv[++i];
+	    } else if (arg == "--export-scene" && i + 1 < argc) {
+		options.exportPath = argv[++i];
+	    } else if (arg == "--lockstep") {
+		options.lockstep = true;
+	    } else if (arg == "--vsync" && i + 1 < argc) {
+		if (!parseSwapMode(argv[++i], options.swapMode)) {
+		    std::cerr << "Unknown vsync mode " << argv[i] << ", expected off, on or adaptive" << std::endl;
+		    return false;
+		}
+	    } else if (arg == "--fps-limit" && i + 1 < argc) {
+		options.frameLimit = std::stof(argv[++i]);
+	    } else if (arg == "--sim-hz" && i + 1 < argc) {
+		options.simulationHz = std::stof(argv[++i]);
+		if (!(options.simulationHz > 0.0f)) {
+		    std::cerr << "--sim-hz must be positive" << std::endl;
+		    return false;
+		}
+	    } else if (arg == "--sim-threads" && i + 1 < argc) {
+		options.simulationThreads = parseUnsigned(argv[++i]);
+	    } else if (arg == "--layout" && i + 1 < argc) {
+		if (!parseSceneLayout(argv[++i], options.generator.layout)) {
+		    std::cerr << "Unknown layout " << argv[i] << ", expected grid, scatter, clustered, overlap or orbits" << std::endl;
+		    return false;
+		}
+		options.generate = true;
+	    } else if (arg == "--count" && i + 1 < argc) {
+		options.generator.count = parseUnsigned(argv[++i]);
+		if (options.generator.count < minGeneratedCount || options.generator.count > maxGeneratedCount) {
+		    std::cerr << "--count must be between " << minGeneratedCount << " and " << maxGeneratedCount << std::endl;
+		    return false;
+		}
+		options.generate = true;
+	    } else if (arg == "--seed" && i + 1 < argc) {
+		options.generator.seed = parseUnsigned(argv[++i]);
+		options.generate = true;
+	    } else if (arg == "--translucent-ratio" && i + 1 < argc) {
+		options.generator.translucentRatio = std::stof(argv[++i]);
+		if (!(options.generator.translucentRatio >= 0.0f && options.generator.translucentRatio <= 1.0f)) {
+		    std::cerr << "--translucent-ratio must be between 0 and 1" << std::endl;
+		    return false;
+		}
+		options.generate = true;
+	    } else if (arg == "--static-ratio" && i + 1 < argc) {
+		options.generator.staticRatio = std::stof(argv[++i]);
+		if (!(options.generator.staticRatio >= 0.0f && options.generator.staticRatio <= 1.0f)) {
+		    std::cerr << "--static-ratio must be between 0 and 1" << std::endl;
+		    return false;
+		}
+		options.generate = true;
+	    } else if (arg == "--golden" && i + 1 < argc) {
+		options.goldenDir = argv[++i];
+	    } else if (arg == "--update-golden") {
+		options.updateGolden = true;
+	    } else if (arg == "--software") {
+		options.software = true;
+	    } else if (arg == "--software-frames" && i + 1 < argc) {
+		options.softwareFrames = parseUnsigned(argv[++i]);
+	    } else if (arg == "--golden-times" && i + 1 < argc) {
+		options.goldenTimes.clear();
+		std::stringstream times(argv[++i]);
+		std::string time;
+		while (std::getline(times, time, ',')) {
+		    options.goldenTimes.push_back(std::stof(time));
+		}
+	    } else if (arg == "--capture" && i + 1 < argc) {
+		options.captureDir = argv[++i];
+	    } else if (arg == "--capture-depth" && i + 1 < argc) {
+		options.captureDepth = parseUnsigned(argv[++i]);
+	    } else if (arg == "--stream" && i + 1 < argc) {
+		options.streamPath = argv[++i];
+	    } else if (arg == "--stream-format" && i + 1 < argc) {
+		if (!parseStreamFormat(argv[++i], options.streamFormat)) {
+		    std::cerr << "Unknown stream format " << argv[i] << ", expected rgba or yuv420" << std::endl;
+		    return false;
+		}
+	    } else if (arg == "--stream-depth" && i + 1 < argc) {
+		options.streamDepth = parseUnsigned(argv[++i]);
+	    } else if (arg == "--stream-drop") {
+		options.streamDrop = true;
+	    } else if (arg == "--stream-size" && i + 1 < argc) {
+		std::string size = argv[++i];
+		size_t x = size.find('x');
+		if (x == std::string::npos) {
+		    std::cerr << "--stream-size expects WIDTHxHEIGHT" << std::endl;
+		    return false;
+		}
+		options.streamWidth = std::stoi(size.substr(0, x));
+		options.streamHeight = std::stoi(size.substr(x + 1));
+	    } else if (arg == "--stream-frames" && i + 1 < argc) {
+		options.streamFrames = parseUnsigned(argv[++i]);
+	    } else if (arg == "--ortho") {
+		options.projection = Projection::Orthographic;
+	    } else if (arg == "--record-threads" && i + 1 < argc) {
+		options.recordThreads = parseUnsigned(argv[++i]);
+	    } else {
+		printUsage(argv[0]);
+		return false;
+	    }
+	}
+    } catch (const std::invalid_argument&) {
+	printUsage(argv[0]);
+	return false;
+    } catch (const std::out_of_range&) {
+	printUsage(argv[0]);
+	return false;
     }
 
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    if (options.updateGolden && options.goldenDir.empty()) {
+	std::cerr << "--update-golden needs --golden dir" << std::endl;
+	return false;
+    }
 
-    // Load OpenGL function pointers with GLAD
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cerr << "Failed to init GLAD" << std::endl;
-        glfwTerminate();
-        return -1;
+    // The software path has no GL to load scene files or stream with
+    if (options.software && (!options.scenePath.empty() || !options.exportPath.empty() || !options.streamPath.empty())) {
+	std::cerr << "--software cannot be combined with --scene, --export-scene or --stream" << std::endl;
+	return false;
     }
 
-    glEnable(GL_DEPTH_TEST); // Enable depth testing
-    glEnable(GL_BLEND); // Enable blending
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Chroma is subsampled in 2x2 blocks
+    if (options.streamWidth <= 0 || options.streamHeight <= 0 || options.streamWidth % 2 != 0 || options.streamHeight % 2 != 0) {
+	std::cerr << "--stream-size needs a positive, even width and height" << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+// Starts out looking at the scene head on. The default grid is framed as
+// it was when the pyramids were placed in clip space; generated scenes may
+// reach far behind the origin, so the far plane follows the count.
+Camera sceneCamera(const Options& options) {
+    Camera camera;
+    if (options.generate && options.scenePath.empty()) {
+	float extent = generatedSceneExtent(options.generator);
+	camera.frame(extent);
+	camera.setClipPlanes(0.01f, std::max(1000.0f, 4.0f * extent + 0.01f * (float)options.generator.count));
+    } else {
+	camera.frame(2.0f);
+    }
+    camera.setProjection(options.projection);
+    return camera;
+}
+
+// Golden frames render at this size whatever the window's
+constexpr int goldenWidth = 640;
+constexpr int goldenHeight = 480;
+
+// Free running software frames match the window the GL path opens
+constexpr int softwareWidth = 800;
+constexpr int softwareHeight = 600;
+
+// Draws the scene with the given model matrices, one per row, and reads
+// the image back as RGB rows top to bottom
+using FrameRenderer = std::function<void(const std::vector<glm::mat4>& transforms, const FrameConstants& frame, std::vector<uint8_t>& rgb)>;
+
+// File name of the golden frame for a simulated time, in whole milliseconds
+std::string goldenFrameName(float time) {
+    std::ostringstream name;
+    name << "frame_" << std::setw(6) << std::setfill('0') << (long)std::lround(time * 1000.0f) << "ms.ppm";
+    return name.str();
+}
+
+// Renders the scene at each fixed simulated time, at golden size, and
+// compares the frames with the images stored in options.goldenDir, or
+// replaces them with --update-golden. Poses come from modelMatricesAt() on
+// the initial scene, so they depend neither on the clock nor on frame
+// pacing.
+//
+// golden.txt lists each image's hash: a frame hashing the same is an exact
+// match and the stored image is not even read. Otherwise it passes if at
+// most 0.1% of its pixels are perceptibly different; failing frames are
+// written next to the golden ones as *.actual.ppm.
+int runGoldenFrames(
+    Scene& scene,
+    const Camera& camera,
+    const FrameRenderer& render,
+    const Options& options)
+{
+    constexpr float maxDifferingFraction = 0.001f;
+
+    const std::string manifestPath = options.goldenDir + "/golden.txt";
+    std::map<std::string, uint64_t> hashes;
+
+    std::ifstream manifest(manifestPath);
+    std::string name;
+    std::string hash;
+    while (manifest >> name >> hash) {
+	hashes[name] = std::stoull(hash, nullptr, 16);
+    }
+
+    std::vector<glm::mat4> transforms(scene.size());
+
+    int failures = 0;
+
+    for (float time : options.goldenTimes) {
+	modelMatricesAt(scene, time, transforms);
+
+	FrameConstants frame;
+	frame.view = camera.view();
+	frame.projection = camera.projectionMatrix((float)goldenWidth / (float)goldenHeight);
+	frame.viewProjection = frame.projection * frame.view;
+	frame.time = time;
+
+	Image image;
+	image.width = goldenWidth;
+	image.height = goldenHeight;
+
+	render(transforms, frame, image.rgb);
+
+	std::string frameName = goldenFrameName(time);
+	std::string path = options.goldenDir + "/" + frameName;
+	uint64_t imageHash = hashImage(image);
+
+	std::cout << "t=" << std::fixed << std::setprecision(3) << time << std::defaultfloat << " " << frameName << ": ";
+
+	if (options.updateGolden) {
+	    if (!writePpm(path, image)) {
+		return -1;
+	    }
+	    hashes[frameName] = imageHash;
+	    std::cout << "updated" << std::endl;
+	    continue;
+	}
+
+	auto stored = hashes.find(frameName);
+	if (stored != hashes.end() && stored->second == imageHash) {
+	    std::cout << "exact match" << std::endl;
+	    continue;
+	}
+
+	Image golden;
+	if (!readPpm(path, golden)) {
+	    std::cout << "FAILED, no golden image" << std::endl;
+	    ++failures;
+	    continue;
+	}
+
+	ImageDiff diff = compareImages(image, golden);
+	if (diff.differingFraction() <= maxDifferingFraction) {
+	    std::cout << "within tolerance, " << diff.differingPixels << " pixels differ, max dE " << diff.maxDeltaE << std::endl;
+	    continue;
+	}
+
+	std::cout << "FAILED, " << diff.differingPixels << " of " << diff.totalPixels
+		  << " pixels differ, max dE " << diff.maxDeltaE << std::endl;
+	writePpm(options.goldenDir + "/" + frameName.substr(0, frameName.size() - 4) + ".actual.ppm", image);
+	++failures;
+    }
+
+    if (options.updateGolden) {
+	std::ofstream out(manifestPath);
+	for (const auto& [file, value] : hashes) {
+	    out << file << " " << std::hex << std::setw(16) << std::setfill('0') << value << std::dec << "\n";
+	}
+	if (!out) {
+	    std::cerr << "Failed to write " << manifestPath << std::endl;
+	    return -1;
+	}
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+// Renders on the CPU only, so it runs where no window or GL context can
+// be created. The scene is built with materials that have no program and
+// without GL meshes; every object is drawn as the pyramid.
+int runSoftware(const Options& options) {
+    Material opaqueMaterial(0, BlendMode::Opaque);
+    Material translucentMaterial(0, BlendMode::Translucent, 0.5f);
+
+    Scene scene;
+    if (options.generate) {
+	buildGeneratedScene(scene, options.generator, nullptr, &opaqueMaterial, &translucentMaterial);
+    } else {
+	buildGridScene(scene, nullptr, &opaqueMaterial);
+    }
+    std::cout << "Pyramid mesh: " << Pyramid::optimizationReport() << std::endl;
+
+    Camera camera = sceneCamera(options);
+
+    // No simulation or loader thread competes for the cores here
+    WorkerPool workers(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    SoftwareRasterizer software;
+
+    std::vector<SoftwareObject> objects;
+    objects.reserve(scene.size());
+    for (const Renderable& renderable : scene.column<Renderable>()) {
+	const Material* material = renderable.material;
+	objects.push_back({ &Pyramid::meshData(), glm::mat4(1.0f), material->alpha, material->isTranslucent() });
+    }
+
+    FrameRenderer render = [&](const std::vector<glm::mat4>& transforms, const FrameConstants& frame, std::vector<uint8_t>& rgb) {
+	for (size_t i = 0; i < objects.size(); ++i) {
+	    objects[i].model = transforms[i];
+	}
+	software.render(objects, frame.viewProjection, workers);
+	software.readColor(rgb);
+    };
+
+    if (!options.goldenDir.empty()) {
+	software.resize(goldenWidth, goldenHeight);
+	return runGoldenFrames(scene, camera, render, options);
+    }
+
+    // The animation one simulation step per frame, as fast as it renders
+    software.resize(softwareWidth, softwareHeight);
+
+    std::vector<glm::mat4> transforms;
+    Image image;
+    image.width = softwareWidth;
+    image.height = softwareHeight;
+    LatencyStats frameTimes;
+
+    for (uint64_t frameIndex = 0; frameIndex < options.softwareFrames; ++frameIndex) {
+	auto start = std::chrono::steady_clock::now();
+
+	float time = (float)frameIndex / options.simulationHz;
+	modelMatricesAt(scene, time, transforms);
 
-    int success{0};
-    char infoLog[512] = {0};
+	FrameConstants frame;
+	frame.view = camera.view();
+	frame.projection = camera.projectionMatrix((float)softwareWidth / (float)softwareHeight);
+	frame.viewProjection = frame.projection * frame.view;
+	frame.time = time;
 
-    // Compile shaders and create shader program 
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
+	render(transforms, frame, image.rgb);
+	frameTimes.record(std::chrono::steady_clock::now() - start);
 
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if(!success) {
-	glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-	std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+	if (!options.captureDir.empty()) {
+	    std::ostringstream name;
+	    name << options.captureDir << "/frame_" << std::setw(6) << std::setfill('0') << frameIndex << ".ppm";
+	    if (!writePpm(name.str(), image)) {
+		return -1;
+	    }
+	}
+    }
+
+    std::cout << "Software frame time: " << frameTimes << std::endl;
+    return 0;
+}
+
+// Owns every GL resource of the scene. They are declared in dependency order
+// and released in reverse when this returns, while the context is still
+// current: the loader stops before the meshes it writes into, the meshes
+// return their ranges before the arena goes away.
+int runScene(GLFWwindow* window, const Options& options) {
+    // Compile shaders and create shader programs
+    Program shaderProgram = createProgram(indirectVertexShaderSource, fragmentShaderSource);
+    if (!shaderProgram) {
 	return -1;
     }
 
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
+    Program translucentProgram = createProgram(translucentVertexShaderSource, translucentFragmentShaderSource);
+    if (!translucentProgram) {
+	return -1;
+    }
 
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if(!success) {
-	glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-	std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    Renderer renderer(options.recordThreads);
+    if (!renderer.oit.isValid()) {
 	return -1;
     }
 
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+    Material opaqueMaterial(shaderProgram.get(), BlendMode::Opaque);
+    Material translucentMaterial(translucentProgram.get(), BlendMode::Translucent, 0.5f);
+
+    GpuBufferArena arena;
+    std::vector<Mesh> meshes;
+    Scene scene;
 
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if(!success) {
-	glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-	std::cerr << "ERROR::SHADER::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
+    // Only scene files stream their meshes; the built-in scenes need no
+    // loader context
+    AsyncMeshLoader loader;
+    if (!options.scenePath.empty() && !loader.start(window)) {
 	return -1;
     }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    if (!options.scenePath.empty()) {
+	if (!loadScene(options.scenePath, loader, arena, meshes, scene, &opaqueMaterial, &translucentMaterial)) {
+	    return -1;
+	}
+    } else if (options.generate) {
+	meshes.emplace_back(arena, Pyramid::meshData(), Pyramid::vertexFormat);
+	buildGeneratedScene(scene, options.generator, &meshes[0], &opaqueMaterial, &translucentMaterial);
+    } else {
+	meshes.emplace_back(arena, Pyramid::meshData(), Pyramid::vertexFormat);
+	buildGridScene(scene, &meshes[0], &opaqueMaterial);
+    }
+
+    if (options.scenePath.empty()) {
+	std::cout << "Pyramid mesh: " << Pyramid::optimizationReport() << std::endl;
+    }
+
+    if (!options.exportPath.empty()) {
+	return exportScene(options.exportPath, scene) ? 0 : -1;
+    }
 
-    std::vector<Pyramid> pyramids;
-    int num_rows = 10;
-    int num_cols = num_rows;
-    float vertical_offset = (2.0f / (float)num_rows);
-    float horizontal_offset = (2.0f / (float)num_rows);
+    Camera camera = sceneCamera(options);
 
-    for (int i = 0; i < num_rows; ++i) {
-	for (int j = 0; j < num_cols; ++j) {
+    if (!options.goldenDir.empty()) {
+	// Every mesh has to be resident before the first golden frame
+	while (!loader.idle()) {
+	    loader.poll([&meshes](uint64_t id) { meshes[id].createVertexArray(); });
+	    std::this_thread::yield();
+	}
+	renderer.resize(goldenWidth, goldenHeight);
+	return runGoldenFrames(scene, camera, [&scene, &renderer](const std::vector<glm::mat4>& transforms, const FrameConstants& frame, std::vector<uint8_t>& rgb) {
+	    renderScene(scene, transforms, nullptr, frame, renderer);
+	    renderer.sceneTarget.readColor(rgb);
+	}, options);
+    }
 
-	    Pyramid pyramid(shaderProgram);
+    // Streamed frames are converted on the GPU when the format asks for it,
+    // read back asynchronously and queued for the stream's writer thread.
+    // The stream is declared first so it outlives the readback's final flush.
+    std::unique_ptr<FrameStream> stream;
+    std::unique_ptr<YuvConverter> yuv;
+    std::unique_ptr<FrameReadback> streamReadback;
+    if (!options.streamPath.empty()) {
+	stream = std::make_unique<FrameStream>(options.streamPath, options.streamDepth, options.streamDrop);
+	if (stream->closed()) {
+	    return -1;
+	}
 
-	    pyramid.translate(
-		glm::vec3(
-		    (-2.0f + horizontal_offset * (1 + i + (j<<1)) ) / 2.0f,
-		    (-2.0f + vertical_offset   * (1 + 0 + (i<<1)) ) / 2.0f,
-		    0.0f
-		)
-	    );
+	bool planar = options.streamFormat == StreamFormat::Yuv420;
+	if (planar) {
+	    yuv = std::make_unique<YuvConverter>();
+	    if (!yuv->isValid()) {
+		return -1;
+	    }
+	}
 
-	    pyramid.scale(
-		glm::vec3(
-		    1.0f / (float)(num_rows + num_rows),
-		    1.0f / (float)(num_rows + num_rows),
-		    1.0f / (float)(num_rows + num_rows)
-		)
-	    );
+	// The planes are already top to bottom in memory; RGBA rows need flipping
+	streamReadback = std::make_unique<FrameReadback>(3, planar ? GL_RED : GL_RGBA, [&stream, planar](const ReadbackFrame& captured) {
+	    if (planar) {
+		stream->push(captured.data, (ptrdiff_t)captured.rowSize, captured.rowSize, captured.height);
+	    } else {
+		stream->push(captured.row(0), -(ptrdiff_t)captured.rowSize, captured.rowSize, captured.height);
+	    }
+	});
+    }
+
+    // The simulation owns the Transform components and the hierarchy; the
+    // GL thread only reads the immutable Renderable and Bounds ones and the
+    // packets. With --lockstep both run on this thread, one after the other.
+    FramePipeline pipeline;
+    LatencyStats latency;
+    FixedStepSimulation simulation(scene, pipeline, options.simulationHz, options.simulationThreads, std::chrono::steady_clock::now());
 
-	    if ((j + i) % 2 == 0) {
-		pyramid.rotateX(180.0f);
+    std::thread simulationThread;
+    if (!options.lockstep) {
+	simulationThread = std::thread([&simulation] {
+	    while (simulation.advance(std::chrono::steady_clock::now())) {
+		std::this_thread::sleep_until(simulation.due());
 	    }
+	});
+    }
 
-	    pyramids.emplace_back(pyramid);
-	}
+    // Transforms interpolated for the moment each frame is rendered, as the
+    // GPU holds them, and the packet they were last brought up to date from
+    std::vector<glm::mat4> transforms;
+    uint64_t shownPacket = ~0ull;
 
-	num_cols--;
+    std::unique_ptr<FrameReadback> readback;
+    if (!options.captureDir.empty()) {
+	readback = std::make_unique<FrameReadback>(options.captureDepth, GL_RGB, [&options](const ReadbackFrame& captured) {
+	    std::ostringstream name;
+	    name << options.captureDir << "/frame_" << std::setw(6) << std::setfill('0') << captured.frame << ".ppm";
+	    writePpm(name.str(), captured.width, captured.height, captured.row(0), -(ptrdiff_t)captured.rowSize);
+	});
     }
+    uint64_t frameIndex = 0;
+
+    FrameLimiter limiter(options.frameLimit);
+    LatencyStats cpuFrame;
 
-    // Main render loop
-    auto t_start = std::chrono::high_resolution_clock::now();
-    float last_time = 0.0f;
+    auto last_frame = std::chrono::steady_clock::now();
 
+    // Main render loop. Input is polled right after the limiter releases
+    // the frame, so it is as fresh as possible when the frame is built.
     while (!glfwWindowShouldClose(window)) {
-        processInput(window);
+        limiter.wait();
+
+        auto polledAt = std::chrono::steady_clock::now();
+        glfwPollEvents();
+
+        auto now = std::chrono::steady_clock::now();
+        float frame_time = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame).count();
+        last_frame = now;
+
+        processInput(window, camera, frame_time);
 
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // Adopt meshes the loader thread finished uploading
+        if (loader.poll([&meshes](uint64_t id) { meshes[id].createVertexArray(); }) > 0 && loader.idle()) {
+            std::cout << "Scene loaded: " << arena.stats() << std::endl;
+        }
 
-        // Update rotation
-        auto t_now = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration_cast<std::chrono::duration<float>>(t_now - t_start).count();
-        float delta_time = time - last_time;
-        last_time = time;
+        // A stream keeps its size whatever the window's
+        int width = options.streamWidth;
+        int height = options.streamHeight;
+        if (!stream) {
+            glfwGetFramebufferSize(window, &width, &height);
+        }
+        renderer.resize(width, height);
 
-	for (auto& pyramid : pyramids) {
-	    pyramid.rotateY(720.0f * delta_time);
-	    pyramid.rotateX(180.0f * delta_time);
-	    pyramid.draw();
+        if (options.lockstep) {
+            simulation.advance(now);
+        }
+
+        FramePacket* packet = pipeline.beginRead();
+        auto simulatedAt = packet->simulatedAt;
+
+	// How far between the packet's two states this frame falls
+	float alpha = std::chrono::duration<float>(now - simulatedAt).count() / packet->step;
+	alpha = std::clamp(alpha, 0.0f, 1.0f);
+
+	// Only rows that differ from what the GPU holds are touched and sent:
+	// from a new packet every row it lists as changed, after that only
+	// the moving ones, whose blend changes with alpha. Static rows stay
+	// as they are.
+	const std::vector<uint32_t>* changedRows = &packet->moved;
+	if (packet->frame != shownPacket) {
+	    shownPacket = packet->frame;
+
+	    if (packet->allChanged || transforms.size() != packet->transforms.size()) {
+		transforms = packet->transforms;
+		changedRows = nullptr;
+	    } else {
+		for (uint32_t row : packet->changed) {
+		    transforms[row] = packet->transforms[row];
+		}
+		changedRows = &packet->changed;
+	    }
 	}
 
+	const std::vector<uint32_t>& moved = packet->moved;
+	size_t taskCount = (moved.size() + objectsPerTask - 1) / objectsPerTask;
+	renderer.workers.run(taskCount, [&](size_t t) {
+	    size_t end = std::min((t + 1) * objectsPerTask, moved.size());
+	    for (size_t k = t * objectsPerTask; k < end; ++k) {
+		uint32_t row = moved[k];
+		transforms[row] = interpolateTransform(packet->previousTransforms[k], packet->transforms[row], alpha);
+	    }
+	});
+
+	// View-projection is computed once here; the GPU combines it with each
+	// pyramid's model matrix
+	FrameConstants frame;
+	frame.view = camera.view();
+	frame.projection = camera.projectionMatrix((float)width / (float)std::max(height, 1));
+	frame.viewProjection = frame.projection * frame.view;
+	frame.time = packet->time - (1.0f - alpha) * packet->step;
+
+	renderScene(scene, transforms, changedRows, frame, renderer);
+	pipeline.endRead(packet);
+
+	if (readback) {
+	    const SceneFramebuffer& target = renderer.sceneTarget;
+	    readback->capture(target.getColorTexture(), target.getWidth(), target.getHeight(), frameIndex);
+	}
+	if (streamReadback) {
+	    const SceneFramebuffer& target = renderer.sceneTarget;
+	    if (yuv) {
+		streamReadback->capture(yuv->convert(target.getColorTexture(), width, height), width, yuv->getPlanesHeight(), frameIndex);
+	    } else {
+		streamReadback->capture(target.getColorTexture(), width, height, frameIndex);
+	    }
+	}
+	++frameIndex;
+
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        auto swappedAt = std::chrono::steady_clock::now();
+        latency.record(swappedAt - simulatedAt);
+        cpuFrame.record(swappedAt - polledAt);
+
+        if (stream && (stream->closed() || (options.streamFrames > 0 && frameIndex >= options.streamFrames))) {
+            break;
+        }
+    }
+
+    pipeline.stop();
+    if (simulationThread.joinable()) {
+	simulationThread.join();
+    }
+
+    std::cout << "Simulation to present latency: " << latency << std::endl;
+    std::cout << "Input poll to swap return: " << cpuFrame << std::endl;
+    std::cout << "Transform uploads: " << renderer.transforms.uploaded() / 1024.0 / std::max<uint64_t>(frameIndex, 1)
+	      << " KiB per frame" << std::endl;
+
+    if (stream) {
+	streamReadback->flush();
+	std::cout << "Streamed " << frameIndex << " frames, " << stream->framesDropped() << " dropped" << std::endl;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+	return -1;
+    }
+
+    // Frames go to stdout, so the log goes to stderr. A reader closing the
+    // pipe shows up as a failed write rather than killing the process.
+    if (options.streamPath == "-") {
+	std::cout.rdbuf(std::cerr.rdbuf());
+    }
+#ifdef SIGPIPE
+    if (!options.streamPath.empty()) {
+	std::signal(SIGPIPE, SIG_IGN);
+    }
+#endif
+
+    // Taken before GLFW is touched, so it works without a display or GPU
+    if (options.software) {
+	return runSoftware(options);
+    }
+
+    // Initialize and configure GLFW
+    init_gl_window();
+
+    // Golden frames render offscreen; there is nothing to show
+    if (!options.goldenDir.empty()) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
+    // Create window
+    GLFWwindow *window = glfwCreateWindow(800, 600, "Multi-Colored Pyramids", NULL, NULL);
+    if (window == nullptr) {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
     }
 
-    for (auto& pyramid : pyramids) {
-	pyramid.cleanup();
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+    // Load OpenGL function pointers with GLAD
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cerr << "Failed to init GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
     }
 
+    glEnable(GL_DEPTH_TEST); // Enable depth testing
+
+    applySwapMode(options.swapMode);
+
+    int result = runScene(window, options);
+
     // Cleanup and terminate
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    return 0;
+    return result;
 }
@@ -0,0 +1,85 @@
+#include <glm/glm.hpp>
+
+#include <engine/scene_generator.hpp>
+#include <engine/vertex_transform.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Every vertex kernel this CPU supports must produce bit for bit what glm's
+// mat4 * vec4 does, for any matrix and any point count, padding included.
+// Exits non-zero if any of them differs.
+
+// The identity and random matrices. A fused multiply-add rounds most
+// products of the latter differently, so contraction shows up at once.
+std::vector<glm::mat4> testMatrices(SceneRandom& random) {
+    std::vector<glm::mat4> matrices;
+
+    matrices.push_back(glm::mat4(1.0f));
+    for (int i = 0; i < 8; ++i) {
+	glm::mat4 m;
+	for (int c = 0; c < 4; ++c) {
+	    for (int r = 0; r < 4; ++r) {
+		m[c][r] = random.uniform(-2.0f, 2.0f);
+	    }
+	}
+	matrices.push_back(m);
+    }
+
+    return matrices;
+}
+
+int main() {
+    SceneRandom random(7);
+    std::vector<glm::mat4> matrices = testMatrices(random);
+
+    // Whole blocks of both widths, and counts that leave padding
+    const size_t counts[] = { 1, 7, 8, 15, 16, 17, 1000 };
+
+    int failures = 0;
+    for (VertexKernel kernel : { VertexKernel::Scalar, VertexKernel::Avx2, VertexKernel::Avx512 }) {
+	if (!vertexKernelSupported(kernel)) {
+	    std::cout << vertexKernelName(kernel) << ": not supported, skipped" << std::endl;
+	    continue;
+	}
+
+	size_t mismatches = 0;
+	for (const glm::mat4& m : matrices) {
+	    for (size_t count : counts) {
+		std::vector<glm::vec3> points(count);
+		for (glm::vec3& p : points) {
+		    p = glm::vec3(random.uniform(-100.0f, 100.0f), random.uniform(-100.0f, 100.0f), random.uniform(-100.0f, 100.0f));
+		}
+
+		PositionBlocks in;
+		in.assign(points);
+		TransformedPositions out;
+		transformPositions(m, in, out, kernel);
+
+		for (size_t i = 0; i < count; ++i) {
+		    glm::vec4 expected = m * glm::vec4(points[i], 1.0f);
+		    glm::vec4 actual = out[i];
+		    for (int r = 0; r < 4; ++r) {
+			if (std::memcmp(&expected[r], &actual[r], sizeof(float)) != 0) {
+			    if (mismatches == 0) {
+				std::cerr << vertexKernelName(kernel) << ": point " << i << " of " << count
+					  << ", component " << r << ": " << actual[r] << ", glm " << expected[r] << std::endl;
+			    }
+			    ++mismatches;
+			}
+		    }
+		}
+	    }
+	}
+
+	if (mismatches > 0) {
+	    std::cout << vertexKernelName(kernel) << ": FAILED, " << mismatches << " components differ" << std::endl;
+	    ++failures;
+	} else {
+	    std::cout << vertexKernelName(kernel) << ": bitwise identical" << std::endl;
+	}
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,596 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <engine/frame_pipeline.hpp>
+#include <engine/scene.hpp>
+#include <engine/scene_generator.hpp>
+#include <engine/vertex_transform.hpp>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Micro-benchmark of the per-object transform update the simulation runs
+// every frame: advance the X/Y spin angles and compose the model matrix.
+// No GL context is created. Every kernel starts from the same generated
+// scene and is checked against the glm path before it is timed.
+//
+// Counts are chosen per kernel so its working set fits L1, L2 and L3 and
+// then clearly overflows L3.
+//
+// The batched vertex transform kernels (vertex_transform.hpp) follow, each
+// one this CPU supports timed and compared with glm's mat4 * vec4. Their
+// bitwise parity is checked by tests/vertex_transform_test.cpp.
+
+// Keeps the compiler from discarding results it can prove are never read
+inline void doNotOptimize(const void* pointer) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r"(pointer) : "memory");
+#else
+    (void)pointer;
+#endif
+}
+
+class TransformKernel {
+public:
+    virtual ~TransformKernel() = default;
+
+    // Advances every object by dt and writes its model matrix
+    virtual void step(float dt) = 0;
+    virtual const glm::mat4* output() const = 0;
+};
+
+// The current path: the Transform component's five matrices, glm::rotate
+// and the full product, exactly as simulateFrame() runs it over the
+// Transform and Motion arrays, then through the (flat) hierarchy. Materials and meshes are never touched, so
+// the objects go without.
+class GlmKernel : public TransformKernel {
+private:
+    Scene objects;
+    FramePacket packet;
+
+public:
+    explicit GlmKernel(const SceneGeneratorOptions& scene)
+        : objects{},
+          packet{}
+    {
+        buildGeneratedScene(objects, scene, nullptr, nullptr, nullptr);
+    }
+
+    static size_t bytesPerObject() {
+	return sizeof(Transform) + sizeof(Motion) + TransformHierarchy::bytesPerNode + sizeof(uint8_t) + sizeof(glm::mat4);
+    }
+
+    void step(float dt) override {
+	simulateFrame(objects, dt, packet);
+    }
+
+    const glm::mat4* output() const override {
+	return packet.transforms.data();
+    }
+};
+
+// Structure of arrays, scalar code. Keeps only the placement's upper 3x4
+// and the two angles, and writes the product Placement * Rx * Ry in closed
+// form instead of multiplying 4x4 matrices.
+class ScalarSoaKernel : public TransformKernel {
+protected:
+    size_t count;
+    std::vector<float> placement[12];   // columns 0-3, rows 0-2
+    std::vector<float> angleX, angleY, spinX, spinY;
+    std::vector<glm::mat4> transforms;
+
+public:
+    explicit ScalarSoaKernel(const SceneGeneratorOptions& scene, size_t padding = 1)
+        : count{0}
+    {
+        generateScene(scene, [this](const GeneratedObject& object) {
+            for (int c = 0; c < 4; ++c) {
+                for (int r = 0; r < 3; ++r) {
+                    placement[c * 3 + r].push_back(object.placement[c][r]);
+                }
+            }
+            angleX.push_back(0.0f);
+            angleY.push_back(0.0f);
+            spinX.push_back(glm::radians(object.spin.x));
+            spinY.push_back(glm::radians(object.spin.y));
+            ++count;
+        });
+
+        // Vector kernels read whole lanes past the end
+        size_t padded = (count + padding - 1) / padding * padding;
+        for (auto& column : placement) {
+            column.resize(padded, 0.0f);
+        }
+        for (auto* array : { &angleX, &angleY, &spinX, &spinY }) {
+            array->resize(padded, 0.0f);
+        }
+        transforms.resize(padded);
+    }
+
+    static size_t bytesPerObject() {
+	return 16 * sizeof(float) + sizeof(glm::mat4);
+    }
+
+    void step(float dt) override {
+	for (size_t i = 0; i < count; ++i) {
+	    angleX[i] += spinX[i] * dt;
+	    angleY[i] += spinY[i] * dt;
+
+	    float cx = std::cos(angleX[i]), sx = std::sin(angleX[i]);
+	    float cy = std::cos(angleY[i]), sy = std::sin(angleY[i]);
+
+	    // Columns of Rx * Ry
+	    float r[3][3] = {
+		{ cy, sx * sy, -cx * sy },
+		{ 0.0f, cx, sx },
+		{ sy, -sx * cy, cx * cy }
+	    };
+
+	    glm::mat4& m = transforms[i];
+	    for (int c = 0; c < 3; ++c) {
+		for (int row = 0; row < 3; ++row) {
+		    m[c][row] = placement[row][i] * r[c][0]
+			+ placement[3 + row][i] * r[c][1]
+			+ placement[6 + row][i] * r[c][2];
+		}
+		m[c][3] = 0.0f;
+	    }
+	    m[3] = glm::vec4(placement[9][i], placement[10][i], placement[11][i], 1.0f);
+	}
+    }
+
+    const glm::mat4* output() const override {
+	return transforms.data();
+    }
+};
+
+// Orientation kept as two quaternions advanced by a per-object step
+// rotation, so no trigonometry runs per frame
+class QuaternionKernel : public TransformKernel {
+private:
+    struct Object {
+	glm::mat4 placement;
+	glm::quat rotationX, rotationY;
+	glm::vec2 spin;
+    };
+
+    std::vector<Object> objects;
+    std::vector<glm::quat> stepX, stepY;
+    std::vector<glm::mat4> transforms;
+    float stepDt;
+
+public:
+    explicit QuaternionKernel(const SceneGeneratorOptions& scene)
+        : objects{},
+          stepX{},
+          stepY{},
+          transforms{},
+          stepDt{-1.0f}
+    {
+        generateScene(scene, [this](const GeneratedObject& object) {
+            objects.push_back({ object.placement, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), object.spin });
+        });
+        transforms.resize(objects.size());
+    }
+
+    static size_t bytesPerObject() {
+	return sizeof(Object) + 2 * sizeof(glm::quat) + sizeof(glm::mat4);
+    }
+
+    void step(float dt) override {
+	// Step rotations only change with the time step
+	if (dt != stepDt) {
+	    stepX.resize(objects.size());
+	    stepY.resize(objects.size());
+	    for (size_t i = 0; i < objects.size(); ++i) {
+		stepX[i] = glm::angleAxis(glm::radians(objects[i].spin.x) * dt, glm::vec3(1.0f, 0.0f, 0.0f));
+		stepY[i] = glm::angleAxis(glm::radians(objects[i].spin.y) * dt, glm::vec3(0.0f, 1.0f, 0.0f));
+	    }
+	    stepDt = dt;
+	}
+
+	for (size_t i = 0; i < objects.size(); ++i) {
+	    Object& object = objects[i];
+	    object.rotationX = glm::normalize(object.rotationX * stepX[i]);
+	    object.rotationY = glm::normalize(object.rotationY * stepY[i]);
+
+	    glm::mat3 r = glm::mat3_cast(object.rotationX * object.rotationY);
+
+	    glm::mat4& m = transforms[i];
+	    for (int c = 0; c < 3; ++c) {
+		m[c] = object.placement[0] * r[c][0] + object.placement[1] * r[c][1] + object.placement[2] * r[c][2];
+	    }
+	    m[3] = object.placement[3];
+	}
+    }
+
+    const glm::mat4* output() const override {
+	return transforms.data();
+    }
+};
+
+#if defined(__SSE2__)
+// Array of structures, one object per iteration, columns as SSE registers
+class SseAosKernel : public TransformKernel {
+private:
+    struct Object {
+	glm::mat4 placement;
+	float angleX, angleY, spinX, spinY;
+    };
+
+    std::vector<Object> objects;
+    std::vector<glm::mat4> transforms;
+
+public:
+    explicit SseAosKernel(const SceneGeneratorOptions& scene)
+        : objects{},
+          transforms{}
+    {
+        generateScene(scene, [this](const GeneratedObject& object) {
+            objects.push_back({ object.placement, 0.0f, 0.0f, glm::radians(object.spin.x), glm::radians(object.spin.y) });
+        });
+        transforms.resize(objects.size());
+    }
+
+    static size_t bytesPerObject() {
+	return sizeof(Object) + sizeof(glm::mat4);
+    }
+
+    void step(float dt) override {
+	for (size_t i = 0; i < objects.size(); ++i) {
+	    Object& object = objects[i];
+	    object.angleX += object.spinX * dt;
+	    object.angleY += object.spinY * dt;
+
+	    float cx = std::cos(object.angleX), sx = std::sin(object.angleX);
+	    float cy = std::cos(object.angleY), sy = std::sin(object.angleY);
+
+	    const float* p = &object.placement[0][0];
+	    __m128 p0 = _mm_loadu_ps(p);
+	    __m128 p1 = _mm_loadu_ps(p + 4);
+	    __m128 p2 = _mm_loadu_ps(p + 8);
+	    __m128 p3 = _mm_loadu_ps(p + 12);
+
+	    float* m = &transforms[i][0][0];
+	    _mm_storeu_ps(m, _mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(cy)),
+		_mm_add_ps(_mm_mul_ps(p1, _mm_set1_ps(sx * sy)), _mm_mul_ps(p2, _mm_set1_ps(-cx * sy)))));
+	    _mm_storeu_ps(m + 4, _mm_add_ps(_mm_mul_ps(p1, _mm_set1_ps(cx)), _mm_mul_ps(p2, _mm_set1_ps(sx))));
+	    _mm_storeu_ps(m + 8, _mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(sy)),
+		_mm_add_ps(_mm_mul_ps(p1, _mm_set1_ps(-sx * cy)), _mm_mul_ps(p2, _mm_set1_ps(cx * cy)))));
+	    _mm_storeu_ps(m + 12, p3);
+	}
+    }
+
+    const glm::mat4* output() const override {
+	return transforms.data();
+    }
+};
+
+// Structure of arrays, four objects per iteration. Sines and cosines are
+// computed first in a scalar pass, then each output element is one vector
+// expression and the four results are transposed into matrices.
+class SseSoaKernel : public ScalarSoaKernel {
+private:
+    std::vector<float> cosX, sinX, cosY, sinY;
+
+public:
+    explicit SseSoaKernel(const SceneGeneratorOptions& scene)
+        : ScalarSoaKernel{scene, 4},
+          cosX(transforms.size()),
+          sinX(transforms.size()),
+          cosY(transforms.size()),
+          sinY(transforms.size())
+    {}
+
+    static size_t bytesPerObject() {
+	return ScalarSoaKernel::bytesPerObject() + 4 * sizeof(float);
+    }
+
+    void step(float dt) override {
+	for (size_t i = 0; i < count; ++i) {
+	    angleX[i] += spinX[i] * dt;
+	    angleY[i] += spinY[i] * dt;
+	    cosX[i] = std::cos(angleX[i]);
+	    sinX[i] = std::sin(angleX[i]);
+	    cosY[i] = std::cos(angleY[i]);
+	    sinY[i] = std::sin(angleY[i]);
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	for (size_t i = 0; i < count; i += 4) {
+	    __m128 cx = _mm_loadu_ps(&cosX[i]), sx = _mm_loadu_ps(&sinX[i]);
+	    __m128 cy = _mm_loadu_ps(&cosY[i]), sy = _mm_loadu_ps(&sinY[i]);
+
+	    __m128 p[12];
+	    for (int k = 0; k < 12; ++k) {
+		p[k] = _mm_loadu_ps(&placement[k][i]);
+	    }
+
+	    // Columns of Rx * Ry, one lane per object
+	    __m128 r[3][3] = {
+		{ cy, _mm_mul_ps(sx, sy), _mm_sub_ps(zero, _mm_mul_ps(cx, sy)) },
+		{ zero, cx, sx },
+		{ sy, _mm_sub_ps(zero, _mm_mul_ps(sx, cy)), _mm_mul_ps(cx, cy) }
+	    };
+
+	    __m128 columns[4][4];
+	    for (int c = 0; c < 3; ++c) {
+		for (int row = 0; row < 3; ++row) {
+		    columns[c][row] = _mm_add_ps(
+			_mm_mul_ps(p[row], r[c][0]),
+			_mm_add_ps(_mm_mul_ps(p[3 + row], r[c][1]), _mm_mul_ps(p[6 + row], r[c][2]))
+		    );
+		}
+		columns[c][3] = zero;
+	    }
+	    columns[3][0] = p[9];
+	    columns[3][1] = p[10];
+	    columns[3][2] = p[11];
+	    columns[3][3] = one;
+
+	    // Rows are lanes; transposing turns each column into one object's
+	    for (int c = 0; c < 4; ++c) {
+		_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+		for (int lane = 0; lane < 4; ++lane) {
+		    _mm_storeu_ps(&transforms[i + lane][c][0], columns[c][lane]);
+		}
+	    }
+	}
+    }
+};
+#endif
+
+struct KernelInfo {
+    const char* name;
+    size_t bytesPerObject;
+    std::unique_ptr<TransformKernel> (*create)(const SceneGeneratorOptions&);
+};
+
+template <typename Kernel>
+KernelInfo kernel(const char* name) {
+    return {
+	name,
+	Kernel::bytesPerObject(),
+	[](const SceneGeneratorOptions& scene) -> std::unique_ptr<TransformKernel> {
+	    return std::make_unique<Kernel>(scene);
+	}
+    };
+}
+
+std::vector<KernelInfo> kernels() {
+    return {
+	kernel<GlmKernel>("glm"),
+	kernel<ScalarSoaKernel>("scalar-soa"),
+#if defined(__SSE2__)
+	kernel<SseAosKernel>("sse-aos"),
+	kernel<SseSoaKernel>("sse-soa"),
+#endif
+	kernel<QuaternionKernel>("quaternion")
+    };
+}
+
+// Data cache sizes in bytes, falling back to common values where the
+// system does not report them
+struct CacheSizes {
+    size_t level[3];
+};
+
+CacheSizes queryCacheSizes() {
+    CacheSizes sizes = {{ 32 << 10, 1 << 20, 32 << 20 }};
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+    long reported[3] = {
+	sysconf(_SC_LEVEL1_DCACHE_SIZE),
+	sysconf(_SC_LEVEL2_CACHE_SIZE),
+	sysconf(_SC_LEVEL3_CACHE_SIZE)
+    };
+    for (int i = 0; i < 3; ++i) {
+	if (reported[i] > 0) {
+	    sizes.level[i] = reported[i];
+	}
+    }
+#endif
+    return sizes;
+}
+
+// Largest difference between the kernel's output and the glm path's after
+// one step, relative to the matrix magnitude
+float parityError(const TransformKernel& kernel, const TransformKernel& reference, size_t count) {
+    float worst = 0.0f;
+
+    for (size_t i = 0; i < count; ++i) {
+	const glm::mat4& a = kernel.output()[i];
+	const glm::mat4& b = reference.output()[i];
+	for (int c = 0; c < 4; ++c) {
+	    for (int r = 0; r < 4; ++r) {
+		float scale = std::max(1.0f, std::fabs(b[c][r]));
+		worst = std::max(worst, std::fabs(a[c][r] - b[c][r]) / scale);
+	    }
+	}
+    }
+    return worst;
+}
+
+// Runs fn, doubling the iteration count until a run lasts minTime, and
+// returns the seconds per iteration
+template <typename Fn>
+double timeIterations(double minTime, Fn&& fn) {
+    size_t iterations = 1;
+    while (true) {
+	auto start = std::chrono::steady_clock::now();
+	for (size_t it = 0; it < iterations; ++it) {
+	    fn();
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (elapsed >= minTime) {
+	    return elapsed / (double)iterations;
+	}
+	iterations *= 2;
+    }
+}
+
+void printResult(const std::string& name, size_t count, size_t bytesPerItem, double seconds, float error, bool mismatch) {
+    double nsPerItem = seconds * 1e9 / (double)count;
+
+    std::cout << std::left << std::setw(24) << name << std::right
+	      << std::setw(12) << count
+	      << std::setw(14) << (count * bytesPerItem >> 10)
+	      << std::setw(14) << std::fixed << std::setprecision(2) << nsPerItem
+	      << std::setw(16) << std::setprecision(1) << 1e3 / nsPerItem
+	      << std::setw(12) << std::scientific << std::setprecision(1) << error
+	      << std::defaultfloat << (mismatch ? "  MISMATCH" : "") << std::endl;
+}
+
+// Times each supported vertex kernel on random positions and compares its
+// output with glm. Returns the number of runs off by more than tolerance.
+int runVertexKernels(const CacheSizes& caches, const char* const levelNames[4], double minTime, const std::string& filter, float tolerance) {
+    constexpr size_t bytesPerVertex = 7 * sizeof(float);   // xyz in, xyzw out
+    int failures = 0;
+
+    SceneRandom random(1);
+    glm::mat4 m;
+    for (int c = 0; c < 4; ++c) {
+	for (int r = 0; r < 4; ++r) {
+	    m[c][r] = random.uniform(-2.0f, 2.0f);
+	}
+    }
+
+    for (VertexKernel kernel : { VertexKernel::Scalar, VertexKernel::Avx2, VertexKernel::Avx512 }) {
+	std::string kernelName = std::string("vertex-") + vertexKernelName(kernel);
+	if (!vertexKernelSupported(kernel) || (!filter.empty() && kernelName.find(filter) == std::string::npos)) {
+	    continue;
+	}
+
+	size_t workingSets[4] = { caches.level[0] / 2, caches.level[1] / 2, caches.level[2] / 2, caches.level[2] * 4 };
+
+	for (int level = 0; level < 4; ++level) {
+	    std::vector<glm::vec3> points(std::max<size_t>(workingSets[level] / bytesPerVertex, 16));
+	    for (glm::vec3& p : points) {
+		p = glm::vec3(random.uniform(-100.0f, 100.0f), random.uniform(-100.0f, 100.0f), random.uniform(-100.0f, 100.0f));
+	    }
+
+	    PositionBlocks in;
+	    in.assign(points);
+	    TransformedPositions out;
+	    transformPositions(m, in, out, kernel);
+
+	    float error = 0.0f;
+	    for (size_t i = 0; i < points.size(); ++i) {
+		glm::vec4 expected = m * glm::vec4(points[i], 1.0f);
+		glm::vec4 actual = out[i];
+		for (int r = 0; r < 4; ++r) {
+		    error = std::max(error, std::fabs(actual[r] - expected[r]) / std::max(1.0f, std::fabs(expected[r])));
+		}
+	    }
+	    if (error > tolerance) {
+		++failures;
+	    }
+
+	    double seconds = timeIterations(minTime, [&] {
+		transformPositions(m, in, out, kernel);
+		doNotOptimize(out.x.data());
+	    });
+
+	    printResult(kernelName + "/" + levelNames[level], points.size(), bytesPerVertex, seconds, error, error > tolerance);
+	}
+    }
+
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    double minTime = 0.25;
+    std::string filter;
+
+    for (int i = 1; i < argc; ++i) {
+	std::string arg = argv[i];
+
+	bool valid = true;
+	if (arg == "--min-time" && i + 1 < argc) {
+	    try {
+		minTime = std::stod(argv[++i]);
+	    } catch (const std::invalid_argument&) {
+		valid = false;
+	    } catch (const std::out_of_range&) {
+		valid = false;
+	    }
+	} else if (arg == "--filter" && i + 1 < argc) {
+	    filter = argv[++i];
+	} else {
+	    valid = false;
+	}
+
+	if (!valid) {
+	    std::cerr << "Usage: " << argv[0] << " [--min-time seconds] [--filter name]" << std::endl;
+	    return -1;
+	}
+    }
+
+    constexpr float dt = 1.0f / 60.0f;
+    constexpr float parityTolerance = 1e-4f;
+
+    CacheSizes caches = queryCacheSizes();
+    const char* levelNames[4] = { "L1", "L2", "L3", "DRAM" };
+
+    std::cout << "Caches: L1 " << (caches.level[0] >> 10) << " KiB, L2 " << (caches.level[1] >> 10)
+	      << " KiB, L3 " << (caches.level[2] >> 10) << " KiB" << std::endl;
+    std::cout << std::left << std::setw(24) << "Benchmark" << std::right
+	      << std::setw(12) << "Objects" << std::setw(14) << "Set (KiB)"
+	      << std::setw(14) << "ns/object" << std::setw(16) << "Mobjects/s"
+	      << std::setw(12) << "Parity" << std::endl;
+
+    int failures = 0;
+
+    for (const KernelInfo& info : kernels()) {
+	if (!filter.empty() && std::string(info.name).find(filter) == std::string::npos) {
+	    continue;
+	}
+
+	// Half of each cache, then four times the last level
+	size_t workingSets[4] = { caches.level[0] / 2, caches.level[1] / 2, caches.level[2] / 2, caches.level[2] * 4 };
+
+	for (int level = 0; level < 4; ++level) {
+	    SceneGeneratorOptions scene;
+	    scene.layout = SceneLayout::Scatter;
+	    scene.count = std::max<size_t>(workingSets[level] / info.bytesPerObject, 4);
+
+	    auto candidate = info.create(scene);
+	    auto reference = kernel<GlmKernel>("glm").create(scene);
+
+	    candidate->step(dt);
+	    reference->step(dt);
+	    float error = parityError(*candidate, *reference, scene.count);
+	    if (error > parityTolerance) {
+		++failures;
+	    }
+
+	    double seconds = timeIterations(minTime, [&] {
+		candidate->step(dt);
+		doNotOptimize(candidate->output());
+	    });
+
+	    printResult(std::string(info.name) + "/" + levelNames[level], scene.count, info.bytesPerObject, seconds, error, error > parityTolerance);
+	}
+    }
+
+    failures += runVertexKernels(caches, levelNames, minTime, filter, parityTolerance);
+
+    return failures == 0 ? 0 : 1;
+}